@@ -0,0 +1,3 @@
+#!/bin/bash
+
+cmake-build-$1/benchmark
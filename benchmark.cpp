@@ -0,0 +1,715 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bimap.h"
+#include "compact_bimap.h"
+#include "concurrent_bimap.h"
+#include "frozen_bimap.h"
+#include "mapped_bimap.h"
+#include "snapshot_bimap.h"
+
+namespace {
+  std::size_t comparisons = 0;
+
+  template <typename T> struct counting_less {
+    bool operator()(const T &a, const T &b) const {
+      ++comparisons;
+      return a < b;
+    }
+  };
+
+  using clock_type = std::chrono::steady_clock;
+
+  template <typename F>
+  void measure(const std::string &name, std::size_t operations, F &&body) {
+    comparisons = 0;
+    auto start = clock_type::now();
+    body();
+    auto elapsed = std::chrono::duration<double, std::nano>(clock_type::now() - start);
+    std::cout << std::left << std::setw(32) << name << std::right
+              << std::setw(10) << std::fixed << std::setprecision(1)
+              << elapsed.count() / operations << " ns/op"
+              << std::setw(10) << std::setprecision(2)
+              << static_cast<double>(comparisons) / operations << " cmp/op"
+              << std::endl;
+  }
+
+  std::vector<std::pair<uint32_t, uint32_t>> random_pairs(std::size_t n, std::mt19937 &e) {
+    std::vector<uint32_t> lefts(n), rights(n);
+    for (std::size_t i = 0; i < n; i++) {
+      lefts[i] = static_cast<uint32_t>(i);
+      rights[i] = static_cast<uint32_t>(i);
+    }
+    std::shuffle(lefts.begin(), lefts.end(), e);
+    std::shuffle(rights.begin(), rights.end(), e);
+
+    std::vector<std::pair<uint32_t, uint32_t>> res(n);
+    for (std::size_t i = 0; i < n; i++) {
+      res[i] = {lefts[i], rights[i]};
+    }
+    return res;
+  }
+
+  // Keys 0..n-1 where key k is drawn with probability proportional to 1 / (k + 1)^s.
+  std::vector<uint32_t> zipf_keys(std::size_t n, std::size_t count, double s, std::mt19937 &e) {
+    std::vector<double> cdf(n);
+    double sum = 0;
+    for (std::size_t k = 0; k < n; k++) {
+      sum += 1 / std::pow(k + 1.0, s);
+      cdf[k] = sum;
+    }
+    std::uniform_real_distribution<double> uniform(0, sum);
+    std::vector<uint32_t> keys(count);
+    for (auto &key : keys) {
+      key = static_cast<uint32_t>(std::lower_bound(cdf.begin(), cdf.end(), uniform(e)) - cdf.begin());
+    }
+    return keys;
+  }
+
+  using counting_bimap = bmp::bimap<uint32_t, uint32_t, counting_less<uint32_t>, counting_less<uint32_t>>;
+
+  void lookup_and_erase(std::size_t n) {
+    std::cout << "== lookup and erase by key, n = " << n << " ==" << std::endl;
+    std::mt19937 e(1488228);
+    auto pairs = random_pairs(n, e);
+
+    counting_bimap b;
+    measure("insert", n, [&] {
+      for (auto const &p : pairs) {
+        b.insert(p.first, p.second);
+      }
+    });
+
+    std::shuffle(pairs.begin(), pairs.end(), e);
+    std::size_t checksum = 0;
+    measure("at_left", n, [&] {
+      for (auto const &p : pairs) {
+        checksum += b.at_left(p.first);
+      }
+    });
+    measure("at_right", n, [&] {
+      for (auto const &p : pairs) {
+        checksum += b.at_right(p.second);
+      }
+    });
+
+    std::shuffle(pairs.begin(), pairs.end(), e);
+    measure("erase_left(key)", n / 2, [&] {
+      for (std::size_t i = 0; i < n / 2; i++) {
+        checksum += b.erase_left(pairs[i].first);
+      }
+    });
+    measure("erase_right(key)", n - n / 2, [&] {
+      for (std::size_t i = n / 2; i < n; i++) {
+        checksum += b.erase_right(pairs[i].second);
+      }
+    });
+    std::cout << "checksum " << checksum << std::endl << std::endl;
+  }
+
+  void erase_by_iterator(std::size_t n) {
+    std::cout << "== erase by iterator, n = " << n << " ==" << std::endl;
+    std::mt19937 e(1488228);
+    auto pairs = random_pairs(n, e);
+
+    counting_bimap b;
+    for (auto const &p : pairs) {
+      b.insert(p.first, p.second);
+    }
+
+    std::shuffle(pairs.begin(), pairs.end(), e);
+    std::vector<counting_bimap::left_iterator> iterators;
+    for (std::size_t i = 0; i < n / 2; i++) {
+      iterators.push_back(b.find_left(pairs[i].first));
+    }
+    measure("erase_left(iterator)", iterators.size(), [&] {
+      for (auto it : iterators) {
+        b.erase_left(it);
+      }
+    });
+    std::size_t rest = b.size();
+    measure("erase_left(first, last)", rest, [&] {
+      b.erase_left(b.begin_left(), b.end_left());
+    });
+    std::cout << std::endl;
+  }
+
+  void bulk_build(std::size_t n) {
+    std::cout << "== build from sorted input, n = " << n << " ==" << std::endl;
+    std::mt19937 e(1488228);
+    auto pairs = random_pairs(n, e);
+    std::sort(pairs.begin(), pairs.end());
+
+    {
+      counting_bimap b;
+      measure("insert", n, [&] {
+        for (auto const &p : pairs) {
+          b.insert(p.first, p.second);
+        }
+      });
+    }
+    {
+      counting_bimap b;
+      measure("assign_sorted", n, [&] {
+        b.assign_sorted(pairs.begin(), pairs.end());
+      });
+    }
+    std::cout << std::endl;
+  }
+
+  void copy(std::size_t n) {
+    std::cout << "== copy, n = " << n << " ==" << std::endl;
+    std::mt19937 e(1488228);
+    counting_bimap b;
+    for (auto const &p : random_pairs(n, e)) {
+      b.insert(p.first, p.second);
+    }
+    measure("bimap(const bimap&)", n, [&] {
+      counting_bimap copy(b);
+    });
+    std::cout << std::endl;
+  }
+
+  // Comparisons are not counted: the counter is not shared safely between threads.
+  void parallel_build(std::size_t n, std::size_t thread_count) {
+    std::cout << "== parallel build and copy, " << thread_count << " threads, n = " << n
+              << " ==" << std::endl;
+    std::mt19937 e(1488228);
+    auto pairs = random_pairs(n, e);
+
+    using map = bmp::bimap<uint32_t, uint32_t>;
+    map b;
+    measure("build_parallel", n, [&] {
+      b = map::build_parallel(pairs.begin(), pairs.end(), thread_count);
+    });
+    measure("bimap(parallel, const bimap&)", n, [&] {
+      map copy(bmp::parallel, b, thread_count);
+    });
+    std::cout << std::endl;
+  }
+
+  void parallel_scans(std::size_t n, std::size_t thread_count) {
+    std::cout << "== parallel scans, " << thread_count << " threads, n = " << n << " ==" << std::endl;
+    std::mt19937 e(1488228);
+    using map = bmp::bimap<uint32_t, uint32_t>;
+    auto pairs = random_pairs(n, e);
+    map b = map::build_parallel(pairs.begin(), pairs.end(), thread_count);
+
+    std::size_t checksum = 0;
+    measure("sequential iteration", n, [&] {
+      for (auto it = b.begin_left(); it != b.end_left(); ++it) {
+        checksum += *it ^ *it.flip();
+      }
+    });
+    measure("transform_reduce", n, [&] {
+      checksum += b.transform_reduce(std::size_t(0), std::plus<>(), [](uint32_t l, uint32_t r) {
+        return static_cast<std::size_t>(l ^ r);
+      }, thread_count);
+    });
+    measure("count_if", n, [&] {
+      checksum += b.count_if([](uint32_t l, uint32_t r) { return l < r; }, thread_count);
+    });
+    std::cout << "checksum " << checksum << std::endl << std::endl;
+  }
+
+  void snapshots(std::size_t n) {
+    std::cout << "== snapshot files, n = " << n << " ==" << std::endl;
+    std::mt19937 e(1488228);
+    using map = bmp::bimap<uint32_t, uint32_t>;
+    map b;
+    for (auto const &p : random_pairs(n, e)) {
+      b.insert(p.first, p.second);
+    }
+    std::string path = "bimap_benchmark_snapshot.bin";
+
+    measure("save", n, [&] {
+      bmp::save(b, path);
+    });
+    measure("load into bimap", n, [&] {
+      map loaded = bmp::load<map>(path);
+    });
+    std::size_t checksum = 0;
+    measure("map file, one lookup", n, [&] {
+      bmp::mapped_bimap<uint32_t, uint32_t> mapped(path);
+      checksum += mapped.at_left(0);
+    });
+    bmp::mapped_bimap<uint32_t, uint32_t> mapped(path);
+    measure("mapped at_left", n, [&] {
+      for (uint32_t i = 0; i < n; i++) {
+        checksum += mapped.at_left(i);
+      }
+    });
+    std::remove(path.c_str());
+    std::cout << "checksum " << checksum << std::endl << std::endl;
+  }
+
+  void frozen_lookups(std::size_t n) {
+    std::cout << "== frozen_bimap lookups, n = " << n << " ==" << std::endl;
+    std::mt19937 e(1488228);
+    auto pairs = random_pairs(n, e);
+    using red_black = bmp::ordered<std::less<uint32_t>, bmp::red_black>;
+    auto b = bmp::bimap<uint32_t, uint32_t, red_black, red_black>::build_parallel(pairs.begin(), pairs.end(), 1);
+    std::shuffle(pairs.begin(), pairs.end(), e);
+
+    std::size_t checksum = 0;
+    measure("red_black at_left", n, [&] {
+      for (auto const &p : pairs) {
+        checksum += b.at_left(p.first);
+      }
+    });
+    auto frozen = b.freeze();
+    measure("frozen at_left", n, [&] {
+      for (auto const &p : pairs) {
+        checksum += frozen.at_left(p.first);
+      }
+    });
+    measure("frozen at_right", n, [&] {
+      for (auto const &p : pairs) {
+        checksum += frozen.at_right(p.second);
+      }
+    });
+    measure("frozen lower_bound_left", n, [&] {
+      for (auto const &p : pairs) {
+        checksum += *frozen.lower_bound_left(p.first);
+      }
+    });
+    std::cout << "checksum " << checksum << std::endl << std::endl;
+  }
+
+  template <typename Map>
+  void simd_search_side(const std::string &name, std::vector<std::pair<uint32_t, uint32_t>> pairs) {
+    std::mt19937 e(1488228);
+    std::size_t n = pairs.size();
+    std::size_t checksum = 0;
+    Map b;
+    measure(name + " insert", n, [&] {
+      for (auto const &p : pairs) {
+        b.insert(p.first, p.second);
+      }
+    });
+    std::shuffle(pairs.begin(), pairs.end(), e);
+    measure(name + " at_left", n, [&] {
+      for (auto const &p : pairs) {
+        checksum += b.at_left(p.first);
+      }
+    });
+    measure(name + " at_right", n, [&] {
+      for (auto const &p : pairs) {
+        checksum += b.at_right(p.second);
+      }
+    });
+    measure(name + " lower_bound_left", n, [&] {
+      for (auto const &p : pairs) {
+        checksum += *b.lower_bound_left(p.first);
+      }
+    });
+    measure(name + " erase_left", n, [&] {
+      for (auto const &p : pairs) {
+        b.erase_left(p.first);
+      }
+    });
+    std::cout << "checksum " << checksum << std::endl;
+  }
+
+  void simd_search(std::size_t n) {
+    std::cout << "== simd_btree against splay tree, n = " << n << " ==" << std::endl;
+    std::mt19937 e(1488228);
+    auto pairs = random_pairs(n, e);
+    simd_search_side<bmp::bimap<uint32_t, uint32_t>>("splay", pairs);
+    simd_search_side<bmp::simd_bimap<uint32_t, uint32_t>>("simd_btree", pairs);
+    std::cout << std::endl;
+  }
+
+  template <typename Balance>
+  void balance_policy(const std::string &name, std::size_t n) {
+    std::cout << "== " << name << ", n = " << n << " ==" << std::endl;
+    using cmp = bmp::ordered<counting_less<uint32_t>, Balance>;
+    std::mt19937 e(1488228);
+    auto pairs = random_pairs(n, e);
+
+    bmp::bimap<uint32_t, uint32_t, cmp, cmp> b;
+    measure("insert", n, [&] {
+      for (auto const &p : pairs) {
+        b.insert(p.first, p.second);
+      }
+    });
+    std::shuffle(pairs.begin(), pairs.end(), e);
+    std::size_t checksum = 0;
+    measure("at_left", n, [&] {
+      for (auto const &p : pairs) {
+        checksum += b.at_left(p.first);
+      }
+    });
+    measure("erase_left(key)", n, [&] {
+      for (auto const &p : pairs) {
+        checksum += b.erase_left(p.first);
+      }
+    });
+    std::cout << "checksum " << checksum << std::endl << std::endl;
+  }
+
+  template <typename Balance>
+  void zipf_lookups(const std::string &name, std::size_t n, std::size_t queries) {
+    std::cout << "== zipf lookups, " << name << ", n = " << n << " ==" << std::endl;
+    using cmp = bmp::ordered<counting_less<uint32_t>, Balance>;
+    std::mt19937 e(1488228);
+    auto pairs = random_pairs(n, e);
+    // hot keys are scattered over the key space
+    std::vector<uint32_t> rank_to_key(n);
+    for (auto const &p : pairs) {
+      rank_to_key[p.second] = p.first;
+    }
+
+    bmp::bimap<uint32_t, uint32_t, cmp, cmp> b;
+    for (auto const &p : pairs) {
+      b.insert(p.first, p.second);
+    }
+    auto keys = zipf_keys(n, queries, 1.0, e);
+    std::size_t checksum = 0;
+    measure("at_left", queries, [&] {
+      for (uint32_t rank : keys) {
+        checksum += b.at_left(rank_to_key[rank]);
+      }
+    });
+    std::cout << "checksum " << checksum << std::endl << std::endl;
+  }
+
+  void batches(std::size_t n, std::size_t batch) {
+    std::cout << "== sorted batches of " << batch << ", n = " << n << " ==" << std::endl;
+    std::mt19937 e(1488228);
+    auto pairs = random_pairs(2 * n, e);
+    std::vector<std::pair<uint32_t, uint32_t>> initial(pairs.begin(), pairs.begin() + n);
+    std::vector<std::pair<uint32_t, uint32_t>> updates(pairs.begin() + n, pairs.begin() + n + batch);
+    std::sort(updates.begin(), updates.end());
+    std::vector<uint32_t> keys;
+    for (auto const &p : updates) {
+      keys.push_back(p.first);
+    }
+
+    // lookups do not splay, so sorted inserts would leave long paths in a splay tree
+    using cmp = bmp::ordered<counting_less<uint32_t>, bmp::red_black>;
+    bmp::bimap<uint32_t, uint32_t, cmp, cmp> single, batched;
+    for (auto const &p : initial) {
+      single.insert(p.first, p.second);
+      batched.insert(p.first, p.second);
+    }
+    std::size_t checksum = 0;
+    measure("insert", batch, [&] {
+      for (auto const &p : updates) {
+        checksum += single.insert(p.first, p.second) != single.end_left();
+      }
+    });
+    measure("insert_batch", batch, [&] {
+      auto inserted = batched.insert_batch(updates.begin(), updates.end());
+      checksum += std::count(inserted.begin(), inserted.end(), true);
+    });
+    measure("find_left", batch, [&] {
+      for (uint32_t key : keys) {
+        checksum += single.find_left(key) != single.end_left();
+      }
+    });
+    measure("find_left_batch", batch, [&] {
+      auto found = batched.find_left_batch(keys.begin(), keys.end());
+      checksum += found.size();
+    });
+    measure("erase_left(key)", batch, [&] {
+      for (uint32_t key : keys) {
+        checksum += single.erase_left(key);
+      }
+    });
+    measure("erase_left_batch", batch, [&] {
+      auto erased = batched.erase_left_batch(keys.begin(), keys.end());
+      checksum += std::count(erased.begin(), erased.end(), true);
+    });
+    std::cout << "checksum " << checksum << std::endl << std::endl;
+  }
+
+  // Unsorted batches of lookups in a map much larger than the last level cache.
+  template <typename Map>
+  void batched_lookups(const std::string &name, std::size_t n, std::size_t batch, std::size_t queries) {
+    std::cout << "== batched lookups of " << batch << ", " << name << ", n = " << n << " ==" << std::endl;
+    std::mt19937 e(1488228);
+    Map b;
+    for (auto const &p : random_pairs(n, e)) {
+      b.insert(p.first, p.second);
+    }
+    std::vector<uint32_t> keys(queries);
+    for (auto &key : keys) {
+      key = static_cast<uint32_t>(e() % n);
+    }
+
+    std::size_t checksum = 0;
+    measure("find_left", queries, [&] {
+      for (uint32_t key : keys) {
+        checksum += *b.find_left(key).flip();
+      }
+    });
+    measure("find_left_batch", queries, [&] {
+      for (std::size_t i = 0; i < queries; i += batch) {
+        auto last = keys.begin() + std::min(queries, i + batch);
+        for (auto it : b.find_left_batch(keys.begin() + i, last)) {
+          checksum += *it.flip();
+        }
+      }
+    });
+    std::cout << "checksum " << checksum << std::endl << std::endl;
+  }
+
+  template <typename Map>
+  void point_queries(const std::string &name, std::size_t n) {
+    std::cout << "== point queries, " << name << ", n = " << n << " ==" << std::endl;
+    std::mt19937 e(1488228);
+    auto pairs = random_pairs(n, e);
+
+    Map b;
+    measure("insert", n, [&] {
+      for (auto const &p : pairs) {
+        b.insert(p.first, p.second);
+      }
+    });
+    std::shuffle(pairs.begin(), pairs.end(), e);
+    std::size_t checksum = 0;
+    measure("at_left", n, [&] {
+      for (auto const &p : pairs) {
+        checksum += b.at_left(p.first);
+      }
+    });
+    measure("at_right", n, [&] {
+      for (auto const &p : pairs) {
+        checksum += b.at_right(p.second);
+      }
+    });
+    measure("erase_left(key)", n, [&] {
+      for (auto const &p : pairs) {
+        checksum += b.erase_left(p.first);
+      }
+    });
+    std::cout << "checksum " << checksum << std::endl << std::endl;
+  }
+
+  template <typename Map>
+  void storage(const std::string &name, std::size_t n, std::size_t bytes_per_pair) {
+    std::cout << "== " << name << ", " << bytes_per_pair << " bytes per pair, n = " << n
+              << " ==" << std::endl;
+    std::mt19937 e(1488228);
+    auto pairs = random_pairs(n, e);
+
+    Map b;
+    measure("insert", n, [&] {
+      for (auto const &p : pairs) {
+        b.insert(p.first, p.second);
+      }
+    });
+    std::shuffle(pairs.begin(), pairs.end(), e);
+    std::size_t checksum = 0;
+    measure("at_left", n, [&] {
+      for (auto const &p : pairs) {
+        checksum += b.at_left(p.first);
+      }
+    });
+    measure("iterate left", n, [&] {
+      for (auto it = b.begin_left(); it != b.end_left(); ++it) {
+        checksum += *it.flip();
+      }
+    });
+    measure("erase_left(key)", n, [&] {
+      for (auto const &p : pairs) {
+        checksum += b.erase_left(p.first);
+      }
+    });
+    std::cout << "checksum " << checksum << std::endl << std::endl;
+  }
+
+  // Bimap behind one mutex, the way it is shared between threads without
+  // concurrent_bimap.
+  struct locked_bimap {
+    bool insert(uint32_t left, uint32_t right) {
+      std::lock_guard lock(mutex);
+      return map.insert(left, right) != map.end_left();
+    }
+
+    bool erase_left(uint32_t left) {
+      std::lock_guard lock(mutex);
+      return map.erase_left(left);
+    }
+
+    std::optional<uint32_t> find_left(uint32_t left) {
+      std::lock_guard lock(mutex);
+      auto it = map.find_left(left);
+      if (it == map.end_left()) {
+        return std::nullopt;
+      }
+      return *it.flip();
+    }
+
+    std::mutex mutex;
+    bmp::bimap<uint32_t, uint32_t> map;
+  };
+
+  // 90% find_left, 5% insert, 5% erase_left, split between the threads.
+  template <typename Map>
+  void mixed_workload(const std::string &name, std::size_t n, std::size_t operations,
+                      std::size_t thread_count) {
+    std::cout << "== 90/10 mixed workload, " << name << ", " << thread_count
+              << " threads, n = " << n << " ==" << std::endl;
+    std::mt19937 e(1488228);
+    auto pairs = random_pairs(n, e);
+
+    Map b;
+    for (std::size_t i = 0; i < n; i += 2) {
+      b.insert(pairs[i].first, pairs[i].second);
+    }
+    std::vector<std::size_t> checksums(thread_count);
+    measure("mixed", operations, [&] {
+      std::vector<std::thread> threads;
+      for (std::size_t t = 0; t < thread_count; t++) {
+        threads.emplace_back([&, t] {
+          std::mt19937 local(static_cast<uint32_t>(t));
+          std::size_t checksum = 0;
+          for (std::size_t i = 0; i < operations / thread_count; i++) {
+            auto const &p = pairs[local() % n];
+            std::size_t kind = local() % 20;
+            if (kind == 0) {
+              checksum += b.insert(p.first, p.second);
+            } else if (kind == 1) {
+              checksum += b.erase_left(p.first);
+            } else {
+              checksum += b.find_left(p.first).value_or(0);
+            }
+          }
+          checksums[t] = checksum;
+        });
+      }
+      for (auto &thread : threads) {
+        thread.join();
+      }
+    });
+    std::size_t checksum = 0;
+    for (std::size_t c : checksums) {
+      checksum += c;
+    }
+    std::cout << "checksum " << checksum << std::endl << std::endl;
+  }
+
+  // Readers look up random keys in snapshots while one writer publishes batches.
+  void snapshot_reads(std::size_t n, std::size_t operations, std::size_t reader_count,
+                      std::size_t batch) {
+    std::cout << "== snapshot_bimap, " << reader_count << " readers, batches of " << batch
+              << ", n = " << n << " ==" << std::endl;
+    std::mt19937 e(1488228);
+    auto pairs = random_pairs(n, e);
+
+    using red_black = bmp::ordered<std::less<uint32_t>, bmp::red_black>;
+    bmp::snapshot_bimap<uint32_t, uint32_t, red_black, red_black> b;
+    for (std::size_t i = 0; i < n; i += 2) {
+      b.insert(pairs[i].first, pairs[i].second);
+    }
+    b.publish();
+    std::atomic<bool> done{false};
+    std::thread writer([&] {
+      std::mt19937 local(0);
+      while (!done.load(std::memory_order_relaxed)) {
+        for (std::size_t i = 0; i < batch; i++) {
+          auto const &p = pairs[local() % n];
+          if (local() % 2) {
+            b.insert(p.first, p.second);
+          } else {
+            b.erase_left(p.first);
+          }
+        }
+        b.publish();
+      }
+    });
+    std::vector<std::size_t> checksums(reader_count);
+    measure("find_left in snapshot", operations, [&] {
+      std::vector<std::thread> readers;
+      for (std::size_t t = 0; t < reader_count; t++) {
+        readers.emplace_back([&, t] {
+          std::mt19937 local(static_cast<uint32_t>(t + 1));
+          std::size_t checksum = 0;
+          auto snapshot = b.snapshot();
+          for (std::size_t i = 0; i < operations / reader_count; i++) {
+            if (i % 1024 == 0) {
+              snapshot = b.snapshot();
+            }
+            auto it = snapshot->find_left(pairs[local() % n].first);
+            checksum += it == snapshot->end_left() ? 0 : *it.flip();
+          }
+          checksums[t] = checksum;
+        });
+      }
+      for (auto &reader : readers) {
+        reader.join();
+      }
+    });
+    done.store(true);
+    writer.join();
+    std::size_t checksum = 0;
+    for (std::size_t c : checksums) {
+      checksum += c;
+    }
+    std::cout << "published " << b.version() << " versions, checksum " << checksum << std::endl
+              << std::endl;
+  }
+}
+
+// Pass --large to also run the benchmarks that need tens of gigabytes.
+int main(int argc, char **argv) {
+  bool large = argc > 1 && std::string(argv[1]) == "--large";
+  lookup_and_erase(1'000'000);
+  erase_by_iterator(1'000'000);
+  bulk_build(1'000'000);
+  copy(1'000'000);
+  snapshots(1'000'000);
+  frozen_lookups(1'000'000);
+  frozen_lookups(10'000'000);
+  simd_search(1'000'000);
+  simd_search(10'000'000);
+  if (large) {
+    simd_search(100'000'000);
+  }
+  for (std::size_t threads : {1, 2, 4, 8}) {
+    parallel_build(4'000'000, threads);
+  }
+  for (std::size_t threads : {1, 2, 4, 8}) {
+    parallel_scans(4'000'000, threads);
+  }
+  balance_policy<bmp::splay>("splay", 1'000'000);
+  balance_policy<bmp::red_black>("red_black", 1'000'000);
+  balance_policy<bmp::treap>("treap", 1'000'000);
+  zipf_lookups<bmp::splay>("splay", 1'000'000, 5'000'000);
+  zipf_lookups<bmp::splay_on_access>("splay_on_access", 1'000'000, 5'000'000);
+  zipf_lookups<bmp::red_black>("red_black", 1'000'000, 5'000'000);
+
+  batches(1'000'000, 10'000);
+  batches(1'000'000, 1'000'000);
+  using red_black = bmp::ordered<std::less<uint32_t>, bmp::red_black>;
+  batched_lookups<bmp::bimap<uint32_t, uint32_t, red_black, red_black>>("red_black", 4'000'000, 256, 4'000'000);
+  batched_lookups<bmp::unordered_bimap<uint32_t, uint32_t>>("unordered_bimap", 4'000'000, 256, 4'000'000);
+  point_queries<bmp::bimap<uint32_t, uint32_t>>("bimap", 1'000'000);
+  point_queries<bmp::unordered_bimap<uint32_t, uint32_t>>("unordered_bimap", 1'000'000);
+
+  using compact = bmp::compact_bimap<uint32_t, uint32_t, counting_less<uint32_t>, counting_less<uint32_t>>;
+  using compact_unthreaded = bmp::compact_bimap<uint32_t, uint32_t, counting_less<uint32_t>,
+                                                counting_less<uint32_t>, false>;
+  storage<counting_bimap>("bimap", 1'000'000, sizeof(counting_bimap::double_node_t));
+  storage<compact>("compact_bimap", 1'000'000, compact::node_size);
+  storage<compact_unthreaded>("compact_bimap without threads", 1'000'000, compact_unthreaded::node_size);
+
+  for (std::size_t threads : {1, 2, 4, 8}) {
+    mixed_workload<locked_bimap>("bimap behind a mutex", 1'000'000, 4'000'000, threads);
+    mixed_workload<bmp::concurrent_bimap<uint32_t, uint32_t>>("concurrent_bimap", 1'000'000, 4'000'000, threads);
+  }
+  snapshot_reads(1'000'000, 4'000'000, 4, 1'000);
+}
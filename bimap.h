@@ -1,15 +1,46 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstdint>
 #include <functional>
 #include <memory>
+#include <memory_resource>
+#include <optional>
 #include <stdexcept>
 #include <iostream>
+#include <iterator>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "btree_index.h"
+#include "hash_index.h"
+#include "parallel.h"
+#include "prefetch.h"
+#include "pool_allocator.h"
 
 namespace bmp {
     class left_tag;
     class right_tag;
 
+    // Tag for constructors that take pairs already ordered by the left comparator.
+    struct sorted_left_t {
+        explicit sorted_left_t() = default;
+    };
+    inline constexpr sorted_left_t sorted_left{};
+
+    // Tag for constructors that use several threads.
+    struct parallel_t {
+        explicit parallel_t() = default;
+    };
+    inline constexpr parallel_t parallel{};
+
+    template<typename Left, typename Right, typename CompareLeft, typename CompareRight>
+    class frozen_bimap;
+
     template<class T, class Tag>
     class base_node {
     public:
@@ -23,6 +54,12 @@ namespace bmp {
                 , size(1) {
         }
 
+        template<class... Args>
+        explicit base_node(std::in_place_t, Args&&... args)
+                : value(std::forward<Args>(args)...)
+                , size(1) {
+        }
+
         friend bool operator==(const base_node& a, const base_node& b) {
             return a.get_value() == b.get_value();
         }
@@ -43,6 +80,15 @@ namespace bmp {
             size = new_size;
         }
 
+        // Per-node state of the balancing policy, e.g. the color of a red-black node.
+        [[nodiscard]] unsigned char get_balance_data() const {
+            return balance_data;
+        }
+
+        void set_balance_data(unsigned char new_balance_data) {
+            balance_data = new_balance_data;
+        }
+
         base_node* parent = nullptr;
         base_node* left = nullptr;
         base_node* right = nullptr;
@@ -51,6 +97,7 @@ namespace bmp {
 
     private:
         T value;
+        unsigned char balance_data = 0;
         std::size_t size;
     };
 
@@ -76,11 +123,349 @@ namespace bmp {
                 : base_node<LeftType, left_tag>(std::move(left_value))
                 , base_node<RightType, right_tag>(std::move(right_value)) {
         }
+
+        // Constructs both values in place from the arguments in the tuples.
+        template<class... LeftArgs, class... RightArgs>
+        double_node(std::piecewise_construct_t, std::tuple<LeftArgs...> left_args, std::tuple<RightArgs...> right_args)
+                : double_node(left_args, right_args,
+                              std::index_sequence_for<LeftArgs...>(), std::index_sequence_for<RightArgs...>()) {
+        }
+
+    private:
+        template<class LeftTuple, class RightTuple, std::size_t... LeftIndices, std::size_t... RightIndices>
+        double_node(LeftTuple& left_args, RightTuple& right_args,
+                    std::index_sequence<LeftIndices...>, std::index_sequence<RightIndices...>)
+                : base_node<LeftType, left_tag>(std::in_place, std::get<LeftIndices>(std::move(left_args))...)
+                , base_node<RightType, right_tag>(std::in_place, std::get<RightIndices>(std::move(right_args))...) {
+        }
+    };
+
+    // Balancing policies of tree. A policy restores its invariants after tree has
+    // linked a new leaf (inserted), removes a node from the shape of the tree
+    // (erase), builds a tree out of sorted nodes with up to the given number of
+    // threads (build) and may restructure the
+    // tree after a lookup found a node (accessed), which it announces with
+    // restructures_on_access. A policy whose invariants depend on where nodes live
+    // clears copies_shape, so that copies are built instead of cloned. Threads are
+    // maintained by tree itself.
+
+    // Self-adjusting splay tree: amortized O(log n), recently inserted values are
+    // close to the root. Without SplayOnAccess only writes splay, so a lookup costs
+    // the depth of the node, which sorted inserts can make O(n). With SplayOnAccess
+    // the nodes found by lookups (and nth and rank) are splayed too, so frequently
+    // read values stay close to the root as well; lookups through a const bimap
+    // modify the tree then and need exclusive access like writes do.
+    template<bool SplayOnAccess>
+    struct basic_splay {
+        static constexpr bool restructures_on_access = SplayOnAccess;
+        static constexpr bool copies_shape = true;
+
+        template<class Tree>
+        static void inserted(Tree& t, typename Tree::node_t* node) {
+            t.splay(node);
+        }
+
+        template<class Tree>
+        static void accessed(const Tree& t, typename Tree::node_t* node) {
+            if constexpr (SplayOnAccess) {
+                t.splay(node);
+            }
+        }
+
+        template<class Tree>
+        static void erase(Tree& t, typename Tree::node_t* node) {
+            t.splay(node);
+            typename Tree::node_t* R = node->right;
+            if (R != nullptr) {
+                R->parent = nullptr;
+            }
+
+            t.root = node->left;
+
+            if (t.root == nullptr) {
+                t.root = R;
+                return;
+            }
+
+            t.root->parent = nullptr;
+            t.splay(t.get_last_node());
+            t.root->right = R;
+            if (R != nullptr) {
+                R->parent = t.root;
+            }
+            t.fix_size(t.root);
+        }
+
+        template<class Tree, class RandomIt>
+        static void build(Tree& t, RandomIt first, RandomIt last, std::size_t thread_count) {
+            t.build_balanced(first, last, thread_count, [](typename Tree::node_t*, std::size_t, std::size_t) {});
+        }
+    };
+
+    using splay = basic_splay<false>;
+    using splay_on_access = basic_splay<true>;
+
+    // Red-black tree: worst-case O(log n) for every operation, lookups never
+    // restructure the tree.
+    struct red_black {
+        static constexpr bool restructures_on_access = false;
+        static constexpr bool copies_shape = true;
+
+        template<class Tree>
+        static void inserted(Tree& t, typename Tree::node_t* node) {
+            using node_t = typename Tree::node_t;
+            t.add_to_sizes(node->parent, 1);
+            set_red(node, true);
+
+            while (node != t.root && is_red(node->parent)) {
+                node_t* P = node->parent;
+                node_t* G = P->parent;
+                node_t* U = (G->left == P) ? G->right : G->left;
+                if (is_red(U)) {
+                    set_red(P, false);
+                    set_red(U, false);
+                    set_red(G, true);
+                    node = G;
+                    continue;
+                }
+                if ((G->left == P) != (P->left == node)) {
+                    t.rotate(node);
+                    std::swap(node, P);
+                }
+                set_red(P, false);
+                set_red(G, true);
+                t.rotate(P);
+            }
+            set_red(t.root, false);
+        }
+
+        template<class Tree>
+        static void erase(Tree& t, typename Tree::node_t* node) {
+            using node_t = typename Tree::node_t;
+            if (node->left != nullptr && node->right != nullptr) {
+                t.swap_with_successor(node);
+            }
+            node_t* parent = node->parent;
+            node_t* child = t.splice_out(node);
+            t.add_to_sizes(parent, -1);
+
+            if (is_red(node)) {
+                return;
+            }
+
+            while (child != t.root && !is_red(child)) {
+                bool is_left = (child == parent->left);
+                node_t* S = is_left ? parent->right : parent->left;
+                if (is_red(S)) {
+                    set_red(S, false);
+                    set_red(parent, true);
+                    t.rotate(S);
+                    S = is_left ? parent->right : parent->left;
+                }
+                node_t* near = is_left ? S->left : S->right;
+                node_t* far = is_left ? S->right : S->left;
+                if (!is_red(near) && !is_red(far)) {
+                    set_red(S, true);
+                    child = parent;
+                    parent = child->parent;
+                    continue;
+                }
+                if (!is_red(far)) {
+                    set_red(near, false);
+                    set_red(S, true);
+                    t.rotate(near);
+                    far = S;
+                    S = near;
+                }
+                set_red(S, is_red(parent));
+                set_red(parent, false);
+                set_red(far, false);
+                t.rotate(S);
+                child = t.root;
+            }
+            if (child != nullptr) {
+                set_red(child, false);
+            }
+        }
+
+        template<class Tree>
+        static void accessed(const Tree&, typename Tree::node_t*) {
+        }
+
+        // The deepest level of a perfectly balanced tree is red, everything else black.
+        template<class Tree, class RandomIt>
+        static void build(Tree& t, RandomIt first, RandomIt last, std::size_t thread_count) {
+            t.build_balanced(first, last, thread_count, [](typename Tree::node_t* node, std::size_t depth, std::size_t height) {
+                set_red(node, depth == height && depth != 0);
+            });
+        }
+
+    private:
+        template<class Node>
+        static bool is_red(const Node* node) {
+            return node != nullptr && node->get_balance_data() != 0;
+        }
+
+        template<class Node>
+        static void set_red(Node* node, bool red) {
+            node->set_balance_data(red ? 1 : 0);
+        }
+    };
+
+    // Treap with priorities hashed from node addresses: expected O(log n) without
+    // storing anything in the nodes, lookups never restructure the tree. Copied
+    // nodes get other priorities, so copies are rebuilt rather than cloned.
+    struct treap {
+        static constexpr bool restructures_on_access = false;
+        static constexpr bool copies_shape = false;
+
+        template<class Tree>
+        static void inserted(Tree& t, typename Tree::node_t* node) {
+            t.add_to_sizes(node->parent, 1);
+            while (node->parent != nullptr && priority(node->parent) < priority(node)) {
+                t.rotate(node);
+            }
+        }
+
+        template<class Tree>
+        static void accessed(const Tree&, typename Tree::node_t*) {
+        }
+
+        template<class Tree>
+        static void erase(Tree& t, typename Tree::node_t* node) {
+            while (node->left != nullptr && node->right != nullptr) {
+                t.rotate(priority(node->left) < priority(node->right) ? node->right : node->left);
+            }
+            typename Tree::node_t* parent = node->parent;
+            t.splice_out(node);
+            t.add_to_sizes(parent, -1);
+        }
+
+        // Cartesian tree construction; the bounds of the subtree of every node are
+        // the closest higher-priority nodes on both sides. It runs on one thread.
+        template<class Tree, class RandomIt>
+        static void build(Tree& t, RandomIt first, RandomIt last, std::size_t) {
+            using node_t = typename Tree::node_t;
+            std::vector<std::size_t> stack;
+            std::vector<std::size_t> subtree_begin(last - first);
+
+            auto at = [first](std::size_t i) -> node_t* {
+                return *(first + i);
+            };
+
+            for (std::size_t i = 0; i < subtree_begin.size(); i++) {
+                node_t* cur = at(i);
+                node_t* last_popped = nullptr;
+                while (!stack.empty() && priority(at(stack.back())) < priority(cur)) {
+                    last_popped = at(stack.back());
+                    last_popped->set_size(i - subtree_begin[stack.back()]);
+                    stack.pop_back();
+                }
+                cur->left = last_popped;
+                cur->right = nullptr;
+                if (last_popped != nullptr) {
+                    last_popped->parent = cur;
+                }
+                if (stack.empty()) {
+                    cur->parent = nullptr;
+                    subtree_begin[i] = 0;
+                } else {
+                    cur->parent = at(stack.back());
+                    cur->parent->right = cur;
+                    subtree_begin[i] = stack.back() + 1;
+                }
+                stack.push_back(i);
+            }
+            for (std::size_t i : stack) {
+                at(i)->set_size(subtree_begin.size() - subtree_begin[i]);
+            }
+
+            t.root = stack.empty() ? nullptr : at(stack.front());
+        }
+
+        // No node has a higher priority than its parent.
+        template<class Node>
+        static std::uint64_t priority(const Node* node) {
+            auto bits = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(node));
+            bits ^= bits >> 33;
+            bits *= 0xff51afd7ed558ccdull;
+            bits ^= bits >> 33;
+            bits *= 0xc4ceb9fe1a85ec53ull;
+            bits ^= bits >> 33;
+            return bits;
+        }
+    };
+
+    // Holds the comparator of ordered: as an empty base where it may be derived
+    // from, as a member for function pointers and final classes.
+    template<class Cmp, bool = std::is_class_v<Cmp> && !std::is_final_v<Cmp>>
+    struct comparator_holder : Cmp {
+        comparator_holder() = default;
+
+        comparator_holder(const Cmp& comparator)
+                : Cmp(comparator) {
+        }
+
+        const Cmp& get_comparator() const {
+            return *this;
+        }
+    };
+
+    template<class Cmp>
+    struct comparator_holder<Cmp, false> {
+        comparator_holder() = default;
+
+        comparator_holder(const Cmp& comparator)
+                : comparator(comparator) {
+        }
+
+        const Cmp& get_comparator() const {
+            return comparator;
+        }
+
+        Cmp comparator{};
+    };
+
+    // Comparator adaptor that selects the balancing policy of one side of a bimap:
+    // bimap<L, R, ordered<std::less<L>, red_black>>.
+    template<class Cmp, class Balance = splay>
+    struct ordered : comparator_holder<Cmp> {
+        using balance_policy = Balance;
+
+        ordered() = default;
+
+        ordered(const Cmp& comparator)
+                : comparator_holder<Cmp>(comparator) {
+        }
+
+        template<class A, class B>
+        bool operator()(const A& a, const B& b) const {
+            return this->get_comparator()(a, b);
+        }
+    };
+
+    template<class Cmp, class = void>
+    struct balance_policy_of {
+        using type = splay;
     };
 
-    template<typename T, typename Tag, typename Cmp = std::less <T>>
+    template<class Cmp>
+    struct balance_policy_of<Cmp, std::void_t<typename Cmp::balance_policy>> {
+        using type = typename Cmp::balance_policy;
+    };
+
+    template<class Cmp>
+    using balance_policy_t = typename balance_policy_of<Cmp>::type;
+
+    template<typename T, typename Tag, typename Cmp = std::less <T>, typename Balance = balance_policy_t<Cmp>>
     class tree {
     public:
+        using node_t = base_node<T, Tag>;
+        using balance_policy = Balance;
+
+        static constexpr bool is_ordered = true;
+        static constexpr bool restructures_on_access = Balance::restructures_on_access;
+
         explicit tree(Cmp comparator = Cmp())
                 : root(nullptr)
                 , comparator(comparator) {
@@ -115,109 +500,257 @@ namespace bmp {
             comparator = cmp;
         }
 
+        // Result of one descent: the node the search stopped at, whether it holds an
+        // equivalent value and, if not, on which side of it the value belongs.
+        struct position {
+            base_node<T, Tag>* place = nullptr;
+            bool found = false;
+            bool to_right = false;
+        };
+
         void insert(base_node<T, Tag>* value_node) {
-            if (root == nullptr) {
-                root = value_node;
-                return;
+            position pos = find_position(value_node->get_value());
+            if (!pos.found) {
+                insert_at(pos, value_node);
+            }
+        }
+
+        // Lookups take any K the comparator can compare with T; bimap only passes
+        // other types than T to transparent comparators.
+        template<class K>
+        position find_position(const K& value) const {
+            position result;
+            base_node<T, Tag>* cur = root;
+            while (cur != nullptr) {
+                result.place = cur;
+                if (comparator(cur->get_value(), value)) {
+                    result.to_right = true;
+                    cur = cur->right;
+                } else if (comparator(value, cur->get_value())) {
+                    result.to_right = false;
+                    cur = cur->left;
+                } else {
+                    result.found = true;
+                    break;
+                }
+            }
+            return result;
+        }
+
+        // Uses `hint` (the node that would follow value, nullptr for the end) when it
+        // is correct and falls back to a full descent otherwise.
+        template<class K>
+        position find_position(base_node<T, Tag>* hint, const K& value) const {
+            base_node<T, Tag>* prev = (hint == nullptr) ? get_last_node() : hint->prev;
+            if ((hint == nullptr || comparator(value, hint->get_value())) &&
+                (prev == nullptr || comparator(prev->get_value(), value))) {
+                if (hint != nullptr && hint->left == nullptr) {
+                    return {hint, false, false};
+                } else {
+                    return {prev, false, true};
+                }
             }
+            return find_position(value);
+        }
 
-            base_node<T, Tag>* find_result = find_place(value_node->get_value());
+        // Links value_node at a position returned by find_position for its value.
+        void insert_at(const position& pos, base_node<T, Tag>* value_node) {
+            assert(!pos.found);
+            base_node<T, Tag>* place = pos.place;
 
-            if (!comparator(find_result->get_value(), value_node->get_value()) &&
-                !comparator(value_node->get_value(), find_result->get_value())) {
+            if (place == nullptr) {
+                root = value_node;
+                fix_size(root);
+                Balance::inserted(*this, value_node);
                 return;
             }
 
-            if (comparator(find_result->get_value(), value_node->get_value())) {
-                find_result->right = value_node;
-                find_result->right->parent = find_result;
+            value_node->parent = place;
+            if (pos.to_right) {
+                place->right = value_node;
 
-                if (find_result->next != nullptr) {
-                    find_result->next->prev = find_result->right;
+                if (place->next != nullptr) {
+                    place->next->prev = value_node;
                 }
-                find_result->right->next = find_result->next;
-
-                find_result->next = find_result->right;
-                find_result->right->prev = find_result;
+                value_node->next = place->next;
 
-                balance(find_result->right);
+                place->next = value_node;
+                value_node->prev = place;
             } else {
-                find_result->left = value_node;
-                find_result->left->parent = find_result;
+                place->left = value_node;
 
-                if (find_result->prev != nullptr) {
-                    find_result->prev->next = find_result->left;
+                if (place->prev != nullptr) {
+                    place->prev->next = value_node;
                 }
-                find_result->left->prev = find_result->prev;
+                value_node->prev = place->prev;
+
+                place->prev = value_node;
+                value_node->next = place;
+            }
+
+            Balance::inserted(*this, value_node);
+        }
 
-                find_result->prev = find_result->left;
-                find_result->left->next = find_result;
+        template<class K>
+        void erase(const K& value) {
+            base_node<T, Tag>* find_result = find(value);
 
-                balance(find_result->left);
+            if (find_result != nullptr) {
+                erase_node(find_result);
             }
         }
 
-        void erase(const T& value) {
-            base_node<T, Tag>* find_result = find_place(value);
+        // Unlinks a node of this tree without comparing values. The node is left
+        // detached, as if it were just constructed.
+        void erase_node(base_node<T, Tag>* node) {
+            if (node->prev != nullptr) {
+                node->prev->next = node->next;
+            }
 
-            if (find_result == nullptr ||
-                comparator(find_result->get_value(), value) ||
-                comparator(value, find_result->get_value())) {
-                return;
+            if (node->next != nullptr) {
+                node->next->prev = node->prev;
             }
 
-            if (find_result->prev != nullptr) {
-                find_result->prev->next = find_result->next;
+            Balance::erase(*this, node);
+            reset_links(node);
+        }
+
+        template<class K>
+        base_node<T, Tag>* find(const K& value) const {
+            position pos = find_position(value);
+            if (!pos.found) {
+                return nullptr;
             }
+            Balance::accessed(*this, pos.place);
+            return pos.place;
+        }
+
+        [[nodiscard]] bool equivalent(const T& a, const T& b) const {
+            return !comparator(a, b) && !comparator(b, a);
+        }
 
-            if (find_result->next != nullptr) {
-                find_result->next->prev = find_result->prev;
+        // Looks up keys[0, count) and stores the found nodes (nullptr if absent) in
+        // out. Up to `lanes` descents run side by side, one level per round, each
+        // prefetching the node it visits next, so that the cache misses of
+        // different descents overlap; a finished lane takes the next key.
+        template<class RandomIt>
+        void find_interleaved(RandomIt keys, std::size_t count, base_node<T, Tag>** out) const {
+            static constexpr std::size_t lanes = 16;
+            std::fill(out, out + count, nullptr);
+            if (root == nullptr) {
+                return;
             }
 
-            base_node<T, Tag>* R = nullptr;
-            if (find_result != nullptr &&
-                !comparator(find_result->get_value(), value) &&
-                !comparator(value, find_result->get_value())) {
-                balance(find_result);
-                std::swap(R, root->right);
-                if (R != nullptr) {
-                    R->parent = nullptr;
-                }
-                fix_size(root);
+            base_node<T, Tag>* cur[lanes];
+            std::size_t key_of[lanes];
+            std::size_t width = std::min(lanes, count);
+            std::size_t next_key = 0;
+            for (std::size_t i = 0; i < width; i++) {
+                cur[i] = root;
+                key_of[i] = next_key++;
             }
 
-            root = root->left;
+            for (std::size_t active = width; active != 0;) {
+                for (std::size_t i = 0; i < width; i++) {
+                    base_node<T, Tag>* node = cur[i];
+                    if (node == nullptr) {
+                        continue;
+                    }
+                    const auto& key = keys[key_of[i]];
+                    if (comparator(node->get_value(), key)) {
+                        node = node->right;
+                    } else if (comparator(key, node->get_value())) {
+                        node = node->left;
+                    } else {
+                        out[key_of[i]] = node;
+                        node = nullptr;
+                    }
 
-            if (root != nullptr) {
-                root->parent = nullptr;
+                    if (node != nullptr) {
+                        prefetch(node);
+                        cur[i] = node;
+                    } else if (next_key < count) {
+                        cur[i] = root;
+                        key_of[i] = next_key++;
+                    } else {
+                        cur[i] = nullptr;
+                        --active;
+                    }
+                }
             }
 
-            if (root == nullptr && R == nullptr) {
-                return;
+            for (std::size_t i = 0; i < count; i++) {
+                if (out[i] != nullptr) {
+                    Balance::accessed(*this, out[i]);
+                }
             }
+        }
 
-            balance(get_last_node());
+        // First node that is not less than value, nullptr if there is none.
+        template<class K>
+        base_node<T, Tag>* lower_bound(const K& value) const {
+            base_node<T, Tag>* result = nullptr;
+            for (base_node<T, Tag>* cur = root; cur != nullptr;) {
+                if (comparator(cur->get_value(), value)) {
+                    cur = cur->right;
+                } else {
+                    result = cur;
+                    cur = cur->left;
+                }
+            }
+            if (result != nullptr) {
+                Balance::accessed(*this, result);
+            }
+            return result;
+        }
 
-            if (root != nullptr) {
-                root->right = R;
-                if (root->right != nullptr) {
-                    root->right->parent = root;
+        // lower_bound that starts at `finger`, a node not greater than value, and
+        // climbs only as far as needed: O(log d) for a value d positions ahead.
+        template<class K>
+        base_node<T, Tag>* lower_bound_from(base_node<T, Tag>* finger, const K& value) const {
+            base_node<T, Tag>* result = nullptr;
+            base_node<T, Tag>* cur = finger;
+            for (; cur->parent != nullptr; cur = cur->parent) {
+                if (cur->parent->left == cur && !comparator(cur->parent->get_value(), value)) {
+                    result = cur->parent;
+                    break;
                 }
-            } else {
-                root = R;
-                root->parent = nullptr;
             }
-            fix_size(root);
+            // below result, only the subtree of cur can hold the answer
+            while (cur != nullptr) {
+                if (comparator(cur->get_value(), value)) {
+                    cur = cur->right;
+                } else {
+                    result = cur;
+                    cur = cur->left;
+                }
+            }
+            if (result != nullptr) {
+                Balance::accessed(*this, result);
+            }
+            return result;
         }
 
-        base_node<T, Tag>* find(const T& value) const {
-            base_node<T, Tag>* find_result = find_place(value);
-            return (find_result != nullptr &&
-                    !comparator(find_result->get_value(), value) &&
-                    !comparator(value, find_result->get_value())) ? find_result : nullptr;
+        // First node that is greater than value, nullptr if there is none.
+        template<class K>
+        base_node<T, Tag>* upper_bound(const K& value) const {
+            base_node<T, Tag>* result = nullptr;
+            for (base_node<T, Tag>* cur = root; cur != nullptr;) {
+                if (comparator(value, cur->get_value())) {
+                    result = cur;
+                    cur = cur->left;
+                } else {
+                    cur = cur->right;
+                }
+            }
+            if (result != nullptr) {
+                Balance::accessed(*this, result);
+            }
+            return result;
         }
 
-        base_node<T, Tag>* find_place(const T& value) const {
+        template<class K>
+        base_node<T, Tag>* find_place(const K& value) const {
             if (root == nullptr) return nullptr;
 
             base_node<T, Tag>* cur = root;
@@ -246,23 +779,256 @@ namespace bmp {
             return size(root);
         }
 
-        friend void swap(tree<T, Tag, Cmp>& first, tree<T, Tag, Cmp>& second) {
+        // k-th node in increasing order (from 0), nullptr if k >= size().
+        base_node<T, Tag>* nth(std::size_t k) const {
+            base_node<T, Tag>* cur = root;
+            while (cur != nullptr) {
+                std::size_t left_size = size(cur->left);
+                if (k < left_size) {
+                    cur = cur->left;
+                } else if (k == left_size) {
+                    Balance::accessed(*this, cur);
+                    return cur;
+                } else {
+                    k -= left_size + 1;
+                    cur = cur->right;
+                }
+            }
+            return nullptr;
+        }
+
+        // Number of values that are less than value. The last node of the path is
+        // the one a self-adjusting policy may restructure around.
+        template<class K>
+        [[nodiscard]] std::size_t rank(const K& value) const {
+            std::size_t result = 0;
+            base_node<T, Tag>* last = nullptr;
+            for (base_node<T, Tag>* cur = root; cur != nullptr;) {
+                last = cur;
+                if (comparator(cur->get_value(), value)) {
+                    result += size(cur->left) + 1;
+                    cur = cur->right;
+                } else {
+                    cur = cur->left;
+                }
+            }
+            if (last != nullptr) {
+                Balance::accessed(*this, last);
+            }
+            return result;
+        }
+
+        // Position of a node of this tree in increasing order, without comparisons.
+        [[nodiscard]] static std::size_t rank_of(const base_node<T, Tag>* node) {
+            std::size_t result = size(node->left);
+            for (; node->parent != nullptr; node = node->parent) {
+                if (node->parent->right == node) {
+                    result += size(node->parent->left) + 1;
+                }
+            }
+            return result;
+        }
+
+        // Builds a tree with threads from nodes that are already in increasing order,
+        // in O(n) and without comparisons, using up to thread_count threads. The tree
+        // must be empty.
+        template<class RandomIt>
+        void build_sorted(RandomIt first, RandomIt last, std::size_t thread_count = 1) {
+            assert(root == nullptr);
+            Balance::build(*this, first, last, thread_count);
+
+            auto n = static_cast<std::size_t>(last - first);
+            parallel_chunks(n, thread_count, [first, n](std::size_t begin, std::size_t end) {
+                for (std::size_t i = begin; i < end; i++) {
+                    base_node<T, Tag>* cur = *(first + i);
+                    cur->prev = i == 0 ? nullptr : *(first + (i - 1));
+                    cur->next = i + 1 == n ? nullptr : *(first + (i + 1));
+                }
+            });
+        }
+
+        // Gives this (empty) tree the shape of `other`, where translate maps each node
+        // of `other` to the node that takes its place here, or builds it from the
+        // translated nodes in order if the policy does not copy shapes.
+        template<class Translate>
+        void clone_links(const tree& other, Translate translate) {
+            assert(root == nullptr);
+            if constexpr (!Balance::copies_shape) {
+                std::vector<base_node<T, Tag>*> nodes;
+                nodes.reserve(size(other.root));
+                for (base_node<T, Tag>* cur = other.get_first_node(); cur != nullptr; cur = cur->next) {
+                    nodes.push_back(translate(cur));
+                }
+                build_sorted(nodes.begin(), nodes.end());
+                return;
+            }
+            root = translate(other.root);
+            for (base_node<T, Tag>* cur = other.get_first_node(); cur != nullptr; cur = cur->next) {
+                base_node<T, Tag>* copy = translate(cur);
+                copy->parent = translate(cur->parent);
+                copy->left = translate(cur->left);
+                copy->right = translate(cur->right);
+                copy->next = translate(cur->next);
+                copy->prev = translate(cur->prev);
+                copy->set_size(cur->get_size());
+                copy->set_balance_data(cur->get_balance_data());
+            }
+        }
+
+        // Forgets all nodes without touching them; their owner frees them.
+        void detach_all() {
+            root = nullptr;
+        }
+
+        // Linking a node allocates nothing here; see hash_index::reserve.
+        void reserve(std::size_t) {
+        }
+
+        friend void swap(tree& first, tree& second) {
             std::swap(first.root, second.root);
             std::swap(first.comparator, second.comparator);
         }
 
     private:
-        [[nodiscard]] std::size_t size(const base_node<T, Tag>* cur) const {
+        friend Balance;
+
+        // Perfectly balanced build; on_build(node, depth, height) is called for every
+        // node, where height is the depth of the deepest node. The subtrees of the
+        // top levels are built in parallel until there is one per thread.
+        template<class RandomIt, class OnBuild>
+        void build_balanced(RandomIt first, RandomIt last, std::size_t thread_count, OnBuild on_build) {
+            std::size_t height = 0;
+            for (auto count = last - first; count > 1; count /= 2) {
+                ++height;
+            }
+            std::size_t parallel_depth = 0;
+            while ((std::size_t(1) << parallel_depth) < thread_count) {
+                ++parallel_depth;
+            }
+            root = build_subtree(first, last, nullptr, 0, height, parallel_depth, on_build);
+        }
+
+        template<class RandomIt, class OnBuild>
+        base_node<T, Tag>* build_subtree(RandomIt first, RandomIt last, base_node<T, Tag>* parent,
+                                         std::size_t depth, std::size_t height, std::size_t parallel_depth,
+                                         OnBuild& on_build) {
+            if (first == last) {
+                return nullptr;
+            }
+            RandomIt middle = first + (last - first) / 2;
+            base_node<T, Tag>* cur = *middle;
+            cur->parent = parent;
+            if (depth < parallel_depth && static_cast<std::size_t>(last - first) >= 2 * parallel_grain) {
+                run_parallel(2, [&](std::size_t i) {
+                    if (i == 0) {
+                        cur->left = build_subtree(first, middle, cur, depth + 1, height, parallel_depth, on_build);
+                    } else {
+                        cur->right = build_subtree(middle + 1, last, cur, depth + 1, height, parallel_depth, on_build);
+                    }
+                });
+            } else {
+                cur->left = build_subtree(first, middle, cur, depth + 1, height, parallel_depth, on_build);
+                cur->right = build_subtree(middle + 1, last, cur, depth + 1, height, parallel_depth, on_build);
+            }
+            fix_size(cur);
+            on_build(cur, depth, height);
+            return cur;
+        }
+
+        // Puts the only child of node (or nullptr) in its place and returns it.
+        base_node<T, Tag>* splice_out(base_node<T, Tag>* node) {
+            assert(node->left == nullptr || node->right == nullptr);
+            base_node<T, Tag>* child = (node->left != nullptr) ? node->left : node->right;
+            base_node<T, Tag>* parent = node->parent;
+            if (child != nullptr) {
+                child->parent = parent;
+            }
+            if (parent == nullptr) {
+                root = child;
+            } else if (parent->left == node) {
+                parent->left = child;
+            } else {
+                parent->right = child;
+            }
+            return child;
+        }
+
+        // Exchanges the places of a node with two children and of its successor,
+        // together with their sizes and balance data.
+        void swap_with_successor(base_node<T, Tag>* node) {
+            base_node<T, Tag>* successor = node->next;
+            assert(node->right != nullptr && successor->left == nullptr);
+
+            base_node<T, Tag>* parent = node->parent;
+            base_node<T, Tag>* successor_parent = successor->parent;
+            base_node<T, Tag>* successor_right = successor->right;
+
+            if (parent == nullptr) {
+                root = successor;
+            } else if (parent->left == node) {
+                parent->left = successor;
+            } else {
+                parent->right = successor;
+            }
+            successor->parent = parent;
+
+            successor->left = node->left;
+            successor->left->parent = successor;
+
+            if (successor_parent == node) {
+                successor->right = node;
+                node->parent = successor;
+            } else {
+                successor->right = node->right;
+                successor->right->parent = successor;
+                successor_parent->left = node;
+                node->parent = successor_parent;
+            }
+
+            node->left = nullptr;
+            node->right = successor_right;
+            if (successor_right != nullptr) {
+                successor_right->parent = node;
+            }
+
+            std::size_t node_size = node->get_size();
+            node->set_size(successor->get_size());
+            successor->set_size(node_size);
+
+            unsigned char node_balance_data = node->get_balance_data();
+            node->set_balance_data(successor->get_balance_data());
+            successor->set_balance_data(node_balance_data);
+        }
+
+        static void add_to_sizes(base_node<T, Tag>* cur, std::ptrdiff_t delta) {
+            for (; cur != nullptr; cur = cur->parent) {
+                cur->set_size(cur->get_size() + delta);
+            }
+        }
+
+        [[nodiscard]] static std::size_t size(const base_node<T, Tag>* cur) {
             return (cur != nullptr) ? cur->get_size() : 0;
         }
 
-        void fix_size(base_node<T, Tag>* cur) {
+        static void reset_links(base_node<T, Tag>* cur) {
+            cur->parent = nullptr;
+            cur->left = nullptr;
+            cur->right = nullptr;
+            cur->next = nullptr;
+            cur->prev = nullptr;
+            cur->set_size(1);
+            cur->set_balance_data(0);
+        }
+
+        static void fix_size(base_node<T, Tag>* cur) {
             if (cur != nullptr) {
                 cur->set_size(1 + size(cur->left) + size(cur->right));
             }
         }
 
-        void rotate(base_node<T, Tag>* cur) {
+        // Rotations and splaying only restructure the tree, so they are available to
+        // const lookups of self-adjusting policies.
+        void rotate(base_node<T, Tag>* cur) const {
             if (cur == nullptr) {
                 return;
             }
@@ -309,44 +1075,109 @@ namespace bmp {
             fix_size(cur);
         }
 
-        void balance(base_node<T, Tag>* cur) {
+        // Splays cur to the root. Iterative, since a splay tree may legitimately be
+        // as deep as it is large.
+        void splay(base_node<T, Tag>* cur) const {
             if (cur == nullptr) {
                 return;
             }
-            if (cur->parent == nullptr) {
-                fix_size(cur);
-                root = cur;
-            } else if (cur->parent->parent == nullptr) {
-                rotate(cur);
-                root = cur;
-            } else {
-                rotate(cur->parent);
-                rotate(cur);
-                balance(cur);
+            while (cur->parent != nullptr) {
+                base_node<T, Tag>* P = cur->parent;
+                base_node<T, Tag>* G = P->parent;
+                if (G == nullptr) {
+                    rotate(cur);
+                } else if ((G->left == P) == (P->left == cur)) {
+                    rotate(P);
+                    rotate(cur);
+                } else {
+                    rotate(cur);
+                    rotate(cur);
+                }
             }
+            fix_size(cur);
+            root = cur;
         }
 
-        base_node<T, Tag>* root;
+        // mutable: self-adjusting policies move found nodes to the root on lookups
+        mutable base_node<T, Tag>* root;
         Cmp comparator;
     };
 
-    template<typename Left,
-            typename Right,
-            typename CompareLeft = std::less<Left>,
-            typename CompareRight = std::less<Right>>
-    class bimap {
-    public:
-        using left_t = Left;
+    // Index of one side of a bimap: a tree for comparators, a btree_index for
+    // ordered<Cmp, simd_btree>, a hash_index for hashed.
+    template<typename T, typename Tag, typename Cmp>
+    struct index_for {
+        using type = tree<T, Tag, Cmp>;
+    };
+
+    template<typename T, typename Tag, typename Cmp>
+    struct index_for<T, Tag, ordered<Cmp, simd_btree>> {
+        using type = btree_index<T, Tag, Cmp>;
+    };
+
+    template<typename T, typename Tag, typename Hash, typename Equal>
+    struct index_for<T, Tag, hashed<Hash, Equal>> {
+        using type = hash_index<T, Tag, Hash, Equal>;
+    };
+
+    template<typename T, typename Tag, typename Cmp>
+    using index_for_t = typename index_for<T, Tag, Cmp>::type;
+
+    // Whether lookups on a side may take keys of other types than its values,
+    // like std::less<> does for std::map; a hashed side needs both functions to be
+    // transparent.
+    template<typename Cmp, typename = void>
+    struct is_transparent : std::false_type {};
+
+    template<typename Cmp>
+    struct is_transparent<Cmp, std::void_t<typename Cmp::is_transparent>> : std::true_type {};
+
+    template<typename Cmp, typename Balance>
+    struct is_transparent<ordered<Cmp, Balance>> : is_transparent<Cmp> {};
+
+    template<typename Hash, typename Equal>
+    struct is_transparent<hashed<Hash, Equal>>
+            : std::bool_constant<is_transparent<Hash>::value && is_transparent<Equal>::value> {};
+
+    template<typename Cmp>
+    inline constexpr bool is_transparent_v = is_transparent<Cmp>::value;
+
+    // Whether K can be looked up on a side with values of type T and then be turned
+    // into such a value: T itself, or anything T is constructible from for a
+    // transparent comparator.
+    template<typename K, typename T, typename Cmp>
+    inline constexpr bool is_key_v = std::is_same_v<std::decay_t<K>, T> ||
+                                     (is_transparent_v<Cmp> && std::is_constructible_v<T, K>);
+
+    // Enables the heterogeneous overload of a lookup, which must not catch iterators.
+    template<typename K, typename Cmp, typename Iterator>
+    using enable_if_transparent_t = std::enable_if_t<is_transparent_v<Cmp> && !std::is_convertible_v<const K&, Iterator>>;
+
+    template<typename Left,
+            typename Right,
+            typename CompareLeft = std::less<Left>,
+            typename CompareRight = std::less<Right>,
+            typename Allocator = std::allocator<std::pair<Left, Right>>>
+    class bimap {
+    public:
+        using left_t = Left;
         using right_t = Right;
+        using allocator_type = Allocator;
 
         using left_node_t = base_node<Left, left_tag>;
         using right_node_t = base_node<Right, right_tag>;
 
-        using left_tree_t = tree<left_t, left_tag, CompareLeft>;
-        using right_tree_t = tree<right_t, right_tag, CompareRight>;
+        using left_tree_t = index_for_t<left_t, left_tag, CompareLeft>;
+        using right_tree_t = index_for_t<right_t, right_tag, CompareRight>;
 
         using double_node_t = double_node<left_t, right_t>;
 
+        using node_allocator_t = typename std::allocator_traits<Allocator>::template rebind_alloc<double_node_t>;
+        using node_traits = std::allocator_traits<node_allocator_t>;
+
+        static_assert(std::is_same_v<typename node_traits::pointer, double_node_t*>,
+                      "Bimap allocator must use raw pointers");
+
         class right_iterator;
         class left_iterator;
 
@@ -480,57 +1311,279 @@ namespace bmp {
             const bimap* bimap_ptr;
         };
 
-        explicit bimap(CompareLeft compare_left = CompareLeft(), CompareRight compare_right = CompareRight())
+        // Owning handle of a pair extracted from a bimap, which can be inserted into
+        // any bimap with an equal allocator without reallocating the pair.
+        class node_type {
+        public:
+            node_type() = default;
+
+            node_type(node_type&& other) noexcept
+                    : node(std::exchange(other.node, nullptr))
+                    , alloc(std::move(other.alloc)) {
+            }
+
+            node_type& operator=(node_type&& other) noexcept {
+                if (this != &other) {
+                    reset();
+                    node = std::exchange(other.node, nullptr);
+                    alloc = std::move(other.alloc);
+                }
+                return *this;
+            }
+
+            ~node_type() {
+                reset();
+            }
+
+            [[nodiscard]] bool empty() const noexcept {
+                return node == nullptr;
+            }
+
+            explicit operator bool() const noexcept {
+                return node != nullptr;
+            }
+
+            const left_t& left() const {
+                return left_value(node);
+            }
+
+            const right_t& right() const {
+                return right_value(node);
+            }
+
+            allocator_type get_allocator() const {
+                return allocator_type(*alloc);
+            }
+
+        private:
+            friend class bimap;
+
+            node_type(double_node_t* node, const node_allocator_t& alloc)
+                    : node(node)
+                    , alloc(alloc) {
+            }
+
+            double_node_t* release() noexcept {
+                return std::exchange(node, nullptr);
+            }
+
+            void reset() noexcept {
+                if (node != nullptr) {
+                    node_traits::destroy(*alloc, node);
+                    node_traits::deallocate(*alloc, node, 1);
+                    node = nullptr;
+                }
+            }
+
+            double_node_t* node = nullptr;
+            std::optional<node_allocator_t> alloc;
+        };
+
+        // Result of insert(node_type&&): where the pair is (or the pair that blocked
+        // it) and, if it was not inserted, the handle that still owns it.
+        struct insert_return_type {
+            left_iterator position;
+            bool inserted;
+            node_type node;
+        };
+
+        explicit bimap(CompareLeft compare_left = CompareLeft(),
+                       CompareRight compare_right = CompareRight(),
+                       const Allocator& alloc = Allocator())
                 : left_cmp(compare_left)
-                , right_cmp(compare_right) {
+                , right_cmp(compare_right)
+                , node_alloc(alloc) {
             left_tree.set_comparator(compare_left);
             right_tree.set_comparator(compare_right);
         }
 
-        bimap(const bimap& other)
-                : left_cmp(other.left_cmp)
-                , right_cmp(other.right_cmp) {
-            left_tree.set_comparator(other.left_cmp);
-            right_tree.set_comparator(other.right_cmp);
+        explicit bimap(const Allocator& alloc)
+                : bimap(CompareLeft(), CompareRight(), alloc) {
+        }
+
+        // Bulk load from pairs sorted by the left comparator in O(n) plus one sort of
+        // the right values (hashing them for a hashed right side). Pairs with an
+        // already seen left or right value are skipped, like insert does; input that
+        // is out of order throws std::invalid_argument.
+        template<class InputIt>
+        bimap(sorted_left_t, InputIt first, InputIt last,
+              CompareLeft compare_left = CompareLeft(),
+              CompareRight compare_right = CompareRight(),
+              const Allocator& alloc = Allocator())
+                : bimap(compare_left, compare_right, alloc) {
+            static_assert(left_tree_t::is_ordered, "sorted input needs an ordered left side");
+            std::vector<double_node_t*> nodes;
+            try {
+                for (; first != last; ++first) {
+                    auto&& pair = *first;
+                    double_node_t* node = create_node(std::forward<decltype(pair)>(pair).first,
+                                                      std::forward<decltype(pair)>(pair).second);
+                    bool in_order = true;
+                    bool duplicate = false;
+                    try {
+                        if (!nodes.empty() && !left_cmp(left_value(nodes.back()), left_value(node))) {
+                            in_order = false;
+                            duplicate = !left_cmp(left_value(node), left_value(nodes.back()));
+                        } else {
+                            nodes.push_back(node);
+                        }
+                    } catch (...) {
+                        destroy_node(node);
+                        throw;
+                    }
+                    if (!in_order) {
+                        destroy_node(node);
+                        if (duplicate) {
+                            continue;
+                        }
+                        throw std::invalid_argument("Bimap input is not sorted by left value");
+                    }
+                }
+                build_from_sorted_nodes(nodes);
+            } catch (...) {
+                // the trees may be linked already; the destructor must not see them
+                for (double_node_t* node : nodes) {
+                    if (node != nullptr) {
+                        destroy_node(node);
+                    }
+                }
+                left_tree.detach_all();
+                right_tree.detach_all();
+                bimap_size = 0;
+                throw;
+            }
+        }
 
-            left_iterator left_tree_iterator = other.begin_left();
+        template<class InputIt>
+        void assign_sorted(InputIt first, InputIt last) {
+            bimap result(sorted_left, first, last, left_cmp, right_cmp, get_allocator());
+            swap_contents(result);
+        }
 
-            while (left_tree_iterator != other.end_left()) {
-                this->insert(*left_tree_iterator, *left_tree_iterator.flip());
-                ++left_tree_iterator;
+        // Bulk load from pairs in any order with up to thread_count threads (0 for
+        // one per hardware thread): the pairs are sorted by left and by right value
+        // with a parallel merge sort, and both trees are built side by side, with
+        // their top subtrees built in parallel. Of pairs with the same left value the
+        // first one is kept, of the remaining pairs with the same right value the one
+        // with the least left value, as for the sorted_left constructor. Nodes are
+        // allocated in parallel only with std::allocator.
+        template<class RandomIt>
+        static bimap build_parallel(RandomIt first, RandomIt last, std::size_t thread_count = 0,
+                                    CompareLeft compare_left = CompareLeft(),
+                                    CompareRight compare_right = CompareRight(),
+                                    const Allocator& alloc = Allocator()) {
+            static_assert(left_tree_t::is_ordered, "parallel build needs an ordered left side");
+            thread_count = resolve_thread_count(thread_count);
+            bimap result(compare_left, compare_right, alloc);
+            std::vector<double_node_t*> nodes(static_cast<std::size_t>(last - first), nullptr);
+            try {
+                result.create_nodes(nodes.size(), thread_count, [&](std::size_t i) {
+                    auto&& pair = *(first + i);
+                    return result.create_node(std::forward<decltype(pair)>(pair).first,
+                                              std::forward<decltype(pair)>(pair).second);
+                }, nodes.data());
+
+                auto& left_cmp = result.left_cmp;
+                parallel_stable_sort(nodes.begin(), nodes.end(), [&left_cmp](double_node_t* a, double_node_t* b) {
+                    return left_cmp(left_value(a), left_value(b));
+                }, thread_count);
+                for (std::size_t i = 1, kept = 0; i < nodes.size(); i++) {
+                    if (!left_cmp(left_value(nodes[kept]), left_value(nodes[i]))) {
+                        result.destroy_node(nodes[i]);
+                        nodes[i] = nullptr;
+                    } else {
+                        kept = i;
+                    }
+                }
+                nodes.erase(std::remove(nodes.begin(), nodes.end(), nullptr), nodes.end());
+
+                result.build_from_sorted_nodes(nodes, thread_count);
+            } catch (...) {
+                for (double_node_t* node : nodes) {
+                    if (node != nullptr) {
+                        result.destroy_node(node);
+                    }
+                }
+                result.left_tree.detach_all();
+                result.right_tree.detach_all();
+                result.bimap_size = 0;
+                throw;
             }
+            return result;
         }
 
-        bimap(bimap&& other) noexcept {
-            std::swap(bimap_size, other.bimap_size);
+        bimap(const bimap& other)
+                : bimap(other, Allocator(node_traits::select_on_container_copy_construction(other.node_alloc))) {
+        }
 
-            swap(left_tree, other.left_tree);
-            swap(right_tree, other.right_tree);
+        // Read-only copy with the same lookup API, laid out for fast searches; needs
+        // frozen_bimap.h.
+        template<typename Frozen = frozen_bimap<Left, Right, CompareLeft, CompareRight>>
+        Frozen freeze() const {
+            return Frozen(*this, left_cmp, right_cmp);
+        }
 
-            std::swap(left_cmp, other.left_cmp);
-            std::swap(right_cmp, other.right_cmp);
+        // Copy with up to thread_count threads (0 for one per hardware thread). The
+        // pairs are read in chunks that start at nth_left and nth_right, and both
+        // trees are built balanced from the copies like build_parallel does, instead
+        // of cloning the shape of other. Bimaps with a hashed side are copied on one
+        // thread.
+        bimap(parallel_t, const bimap& other, std::size_t thread_count = 0)
+                : bimap(other.left_cmp, other.right_cmp,
+                        Allocator(node_traits::select_on_container_copy_construction(other.node_alloc))) {
+            if constexpr (left_tree_t::is_ordered && right_tree_t::is_ordered) {
+                copy_parallel(other, resolve_thread_count(thread_count));
+            } else {
+                copy_links(other);
+            }
         }
 
-        bimap& operator=(const bimap& other) {
-            *this = bimap(other);
+        // Copies both trees shape for shape in O(n), without comparisons.
+        bimap(const bimap& other, const Allocator& alloc)
+                : bimap(other.left_cmp, other.right_cmp, alloc) {
+            copy_links(other);
+        }
 
-            return *this;
+        bimap(bimap&& other) noexcept
+                : node_alloc(other.node_alloc) {
+            swap_contents(other);
         }
 
-        bimap& operator=(bimap&& other) noexcept {
-            std::swap(bimap_size, other.bimap_size);
+        bimap& operator=(const bimap& other) {
+            if (this != &other) {
+                constexpr bool propagate = node_traits::propagate_on_container_copy_assignment::value;
+                bimap copy(other, Allocator(propagate ? other.node_alloc : node_alloc));
+                swap_contents(copy);
+                if constexpr (propagate) {
+                    std::swap(node_alloc, copy.node_alloc);
+                }
+            }
 
-            swap(left_tree, other.left_tree);
-            swap(right_tree, other.right_tree);
+            return *this;
+        }
 
-            std::swap(left_cmp, other.left_cmp);
-            std::swap(right_cmp, other.right_cmp);
+        bimap& operator=(bimap&& other) noexcept(node_traits::propagate_on_container_move_assignment::value ||
+                                                 node_traits::is_always_equal::value) {
+            if constexpr (node_traits::propagate_on_container_move_assignment::value) {
+                swap_contents(other);
+                std::swap(node_alloc, other.node_alloc);
+            } else if (node_alloc == other.node_alloc) {
+                swap_contents(other);
+            } else {
+                // nodes can not change owner, so they are copied into our own memory
+                bimap copy(other, Allocator(node_alloc));
+                swap_contents(copy);
+            }
 
             return *this;
         }
 
         ~bimap() {
-            subtree_deleter(left_tree.get_root());
+            clear();
+        }
+
+        allocator_type get_allocator() const {
+            return allocator_type(node_alloc);
         }
 
         left_iterator insert(const left_t& left, const right_t& right) {
@@ -549,54 +1602,88 @@ namespace bmp {
             return basic_insert<left_t, right_t>(std::forward<left_t>(left), std::forward<right_t>(right));
         }
 
+        // Returns the inserted pair, or the pair that blocked the insertion (the one
+        // with an equal left value if there is such, otherwise the one with an equal
+        // right value) together with false.
+        template<class L = left_t, class R = right_t,
+                typename = std::enable_if_t<std::is_same_v<std::decay_t<L>, left_t> &&
+                                            std::is_same_v<std::decay_t<R>, right_t>>>
+        std::pair<left_iterator, bool> try_insert(L&& left, R&& right) {
+            return basic_try_insert(nullptr, std::forward<L>(left), std::forward<R>(right));
+        }
+
+        // Like try_insert, but left and right may be any keys the values are
+        // constructible from when the comparators are transparent. The values are
+        // only constructed, in place, if neither of them is in the bimap yet.
+        template<class L, class R,
+                typename = std::enable_if_t<is_key_v<L, left_t, CompareLeft> && is_key_v<R, right_t, CompareRight>>>
+        std::pair<left_iterator, bool> try_emplace(L&& left, R&& right) {
+            return basic_try_insert(nullptr, std::forward<L>(left), std::forward<R>(right));
+        }
+
+        // Constructs the pair in place from the arguments in the tuples, like
+        // std::map::emplace, and keeps it if neither value is in the bimap yet.
+        // Otherwise returns the pair that blocked it, as try_insert does.
+        template<class... LeftArgs, class... RightArgs>
+        std::pair<left_iterator, bool> emplace(std::piecewise_construct_t,
+                                               std::tuple<LeftArgs...> left_args,
+                                               std::tuple<RightArgs...> right_args) {
+            node_type handle(create_node(std::piecewise_construct, std::move(left_args), std::move(right_args)),
+                             node_alloc);
+            insert_return_type result = insert(std::move(handle));
+            return {result.position, result.inserted};
+        }
+
+        // Like insert, but the left value is linked right before `hint` without a
+        // search when it belongs there.
+        template<class L = left_t, class R = right_t,
+                typename = std::enable_if_t<std::is_same_v<std::decay_t<L>, left_t> &&
+                                            std::is_same_v<std::decay_t<R>, right_t>>>
+        left_iterator insert_hint(left_iterator hint, L&& left, R&& right) {
+            auto result = basic_try_insert(&hint, std::forward<L>(left), std::forward<R>(right));
+            return result.second ? result.first : end_left();
+        }
+
         left_iterator erase_left(left_iterator it) {
             auto next_iterator = ++(left_iterator(it));
-            left_tree.erase(*it);
-            right_tree.erase(*it.flip());
+            auto* double_node_ptr = static_cast<double_node_t*>(it.get_node());
+            left_tree.erase_node(double_node_ptr);
+            right_tree.erase_node(double_node_ptr);
             --bimap_size;
 
-            delete static_cast<double_node_t*>(it.get_node());
+            destroy_node(double_node_ptr);
 
             return next_iterator;
         }
 
         bool erase_left(const left_t& left) {
-            if (left_tree.find(left) == nullptr) {
-                return false;
-            }
-            auto* node_ptr = left_tree.find(left);
-            right_tree.erase(at_left(left));
-            left_tree.erase(left);
-            --bimap_size;
-
-            delete static_cast<double_node_t*>(node_ptr);
+            return erase_found(left_tree.find(left));
+        }
 
-            return true;
+        template<typename K, typename = enable_if_transparent_t<K, CompareLeft, left_iterator>>
+        bool erase_left(const K& left) {
+            return erase_found(left_tree.find(left));
         }
 
         right_iterator erase_right(right_iterator it) {
             auto next_iterator = ++(right_iterator(it));
-            right_tree.erase(*it);
-            left_tree.erase(*it.flip());
+            auto* double_node_ptr = static_cast<double_node_t*>(it.get_node());
+            right_tree.erase_node(double_node_ptr);
+            left_tree.erase_node(double_node_ptr);
             --bimap_size;
 
-            delete static_cast<double_node_t*>(it.get_node());
+            destroy_node(double_node_ptr);
 
             return next_iterator;
         }
 
         bool erase_right(const right_t& right) {
-            if (right_tree.find(right) == nullptr) {
-                return false;
-            }
-            auto* node_ptr = right_tree.find(right);
-            left_tree.erase(at_right(right));
-            right_tree.erase(right);
-            --bimap_size;
-
-            delete static_cast<double_node_t*>(node_ptr);
+            return erase_found(right_tree.find(right));
+        }
 
-            return true;
+        template<typename K, typename = enable_if_transparent_t<K, CompareRight, right_iterator>>
+        bool erase_right(const K& right) {
+            return erase_found(right_tree.find(right));
         }
 
         left_iterator erase_left(left_iterator first, left_iterator last) {
@@ -615,39 +1702,221 @@ namespace bmp {
             return last;
         }
 
+        // Unlinks the pair from the bimap and hands it over without copying it.
+        node_type extract_left(left_iterator it) {
+            return extract_found(it.get_node());
+        }
+
+        node_type extract_right(right_iterator it) {
+            return extract_found(it.get_node());
+        }
+
+        node_type extract_left(const left_t& left) {
+            left_node_t* found = left_tree.find(left);
+            return found == nullptr ? node_type() : extract_found(found);
+        }
+
+        node_type extract_right(const right_t& right) {
+            right_node_t* found = right_tree.find(right);
+            return found == nullptr ? node_type() : extract_found(found);
+        }
+
+        // Links the pair owned by the handle, unless one of its values is taken. The
+        // handle must come from a bimap with an equal allocator.
+        insert_return_type insert(node_type&& handle) {
+            if (handle.empty()) {
+                return {end_left(), false, node_type()};
+            }
+            assert(handle.get_allocator() == get_allocator());
+
+            auto [position, inserted] = link_node(handle.node);
+            if (!inserted) {
+                return {position, false, std::move(handle)};
+            }
+            handle.release();
+            return {position, true, node_type()};
+        }
+
+        // Moves every pair of source whose values are both free here into this bimap,
+        // relinking the nodes. The allocators must be equal.
+        void merge(bimap& source) {
+            assert(source.get_allocator() == get_allocator());
+            if (&source == this) {
+                return;
+            }
+
+            left_node_t* cur = source.left_tree.get_first_node();
+            while (cur != nullptr) {
+                auto* double_node_ptr = static_cast<double_node_t*>(cur);
+                cur = cur->next;
+
+                reserve_for_insert();
+                auto left_pos = left_tree.find_position(left_value(double_node_ptr));
+                if (left_pos.found) {
+                    continue;
+                }
+                auto right_pos = right_tree.find_position(right_value(double_node_ptr));
+                if (right_pos.found) {
+                    continue;
+                }
+
+                source.unlink_node(double_node_ptr);
+                left_tree.insert_at(left_pos, double_node_ptr);
+                right_tree.insert_at(right_pos, double_node_ptr);
+                ++bimap_size;
+            }
+        }
+
+        void merge(bimap&& source) {
+            merge(source);
+        }
+
+        // Batch operations. Each has the effect of the single-element operation
+        // applied to the elements in order and reports its result per element. On an
+        // ordered left side, batches sorted by left value are served by finger
+        // searches from the previous element instead of searches from the root;
+        // large strictly sorted batches (at least size() elements) are merged with
+        // the trees in O(n + m log m) when both sides are ordered.
+        template<class InputIt>
+        std::vector<bool> insert_batch(InputIt first, InputIt last) {
+            if constexpr (left_tree_t::is_ordered && right_tree_t::is_ordered && is_forward_iterator_v<InputIt>) {
+                auto count = static_cast<std::size_t>(std::distance(first, last));
+                if (count != 0 && count >= size() &&
+                    std::adjacent_find(first, last, [this](const auto& a, const auto& b) {
+                        return !left_cmp(a.first, b.first);
+                    }) == last) {
+                    return merge_sorted_batch(first, last, count);
+                }
+            }
+
+            std::vector<bool> inserted;
+            left_node_t* finger = nullptr;
+            for (; first != last; ++first) {
+                auto&& pair = *first;
+                if constexpr (left_tree_t::is_ordered) {
+                    left_node_t* next = seek_left(finger, pair.first);
+                    if (next != nullptr && !left_cmp(pair.first, next->get_value())) {
+                        inserted.push_back(false);
+                        finger = next;
+                        continue;
+                    }
+                    left_iterator hint(this, next);
+                    auto result = basic_try_insert(&hint, std::forward<decltype(pair)>(pair).first,
+                                                   std::forward<decltype(pair)>(pair).second);
+                    inserted.push_back(result.second);
+                    finger = result.second ? result.first.node : (next != nullptr ? next->prev : nullptr);
+                } else {
+                    inserted.push_back(basic_try_insert(nullptr, std::forward<decltype(pair)>(pair).first,
+                                                        std::forward<decltype(pair)>(pair).second).second);
+                }
+            }
+            return inserted;
+        }
+
+        template<class InputIt>
+        std::vector<bool> erase_left_batch(InputIt first, InputIt last) {
+            if constexpr (left_tree_t::is_ordered && right_tree_t::is_ordered && is_forward_iterator_v<InputIt>) {
+                auto count = static_cast<std::size_t>(std::distance(first, last));
+                if (count != 0 && count >= size() &&
+                    std::is_sorted(first, last, [this](const auto& a, const auto& b) {
+                        return left_cmp(a, b);
+                    })) {
+                    return erase_sorted_batch(first, last, count);
+                }
+            }
+
+            std::vector<bool> erased;
+            left_node_t* finger = nullptr;
+            for (; first != last; ++first) {
+                if constexpr (left_tree_t::is_ordered) {
+                    left_node_t* next = seek_left(finger, *first);
+                    bool found = next != nullptr && !left_cmp(*first, next->get_value());
+                    finger = (next != nullptr) ? next->prev : nullptr;
+                    if (found) {
+                        erase_found(next);
+                    }
+                    erased.push_back(found);
+                } else {
+                    erased.push_back(erase_left(*first));
+                }
+            }
+            return erased;
+        }
+
+        // Sorted batches of keys use finger searches; other batches interleave the
+        // lookups of several keys to overlap their cache misses.
+        template<class InputIt>
+        std::vector<left_iterator> find_left_batch(InputIt first, InputIt last) const {
+            if constexpr (left_tree_t::is_ordered && is_forward_iterator_v<InputIt>) {
+                if (std::is_sorted(first, last, [this](const auto& a, const auto& b) { return left_cmp(a, b); })) {
+                    std::vector<left_iterator> found;
+                    left_node_t* finger = nullptr;
+                    for (; first != last; ++first) {
+                        left_node_t* next = seek_left(finger, *first);
+                        if (next != nullptr && !left_cmp(*first, next->get_value())) {
+                            found.emplace_back(this, next);
+                            finger = next;
+                        } else {
+                            found.push_back(end_left());
+                            finger = (next != nullptr) ? next->prev : nullptr;
+                        }
+                    }
+                    return found;
+                }
+            }
+            return find_interleaved<left_iterator>(left_tree, first, last);
+        }
+
+        template<class InputIt>
+        std::vector<right_iterator> find_right_batch(InputIt first, InputIt last) const {
+            return find_interleaved<right_iterator>(right_tree, first, last);
+        }
+
         left_iterator find_left(const left_t& left) const {
             left_node_t* node_ptr = left_tree.find(left);
 
             return left_iterator(this, node_ptr);
         }
 
+        template<typename K, typename = enable_if_transparent_t<K, CompareLeft, left_iterator>>
+        left_iterator find_left(const K& left) const {
+            return left_iterator(this, left_tree.find(left));
+        }
+
         right_iterator find_right(const right_t& right) const {
             right_node_t* node_ptr = right_tree.find(right);
 
             return right_iterator(this, node_ptr);
         }
 
+        template<typename K, typename = enable_if_transparent_t<K, CompareRight, right_iterator>>
+        right_iterator find_right(const K& right) const {
+            return right_iterator(this, right_tree.find(right));
+        }
+
         const right_t& at_left(const left_t& key) const {
-            if (left_tree.find(key) == nullptr) {
-                throw std::out_of_range("Bimap does not contains left key");
-            }
+            return right_at(left_tree.find(key));
+        }
 
-            return static_cast<right_node_t*>(static_cast<double_node_t*>(left_tree.find(key)))->get_value();
+        template<typename K, typename = enable_if_transparent_t<K, CompareLeft, left_iterator>>
+        const right_t& at_left(const K& key) const {
+            return right_at(left_tree.find(key));
         }
 
         const left_t& at_right(const right_t& key) const {
-            if (right_tree.find(key) == nullptr) {
-                throw std::out_of_range("Bimap does not contains right key");
-            }
+            return left_at(right_tree.find(key));
+        }
 
-            return static_cast<left_node_t*>(static_cast<double_node_t*>(right_tree.find(key)))->get_value();
+        template<typename K, typename = enable_if_transparent_t<K, CompareRight, right_iterator>>
+        const left_t& at_right(const K& key) const {
+            return left_at(right_tree.find(key));
         }
 
         template<typename T,
                 typename = std::enable_if_t<std::is_same_v<T, right_t> && std::is_default_constructible_v<left_t>>>
         const right_t& at_left_or_default(const T& key) {
-            if (left_tree.find(key) != nullptr) {
-                return *left_iterator(this, left_tree.find_place(key)).flip();
+            if (left_node_t* node_ptr = left_tree.find(key); node_ptr != nullptr) {
+                return *left_iterator(this, node_ptr).flip();
             } else {
                 right_t default_right = right_t();
                 if (find_right(default_right) != end_right()) {
@@ -660,8 +1929,8 @@ namespace bmp {
         template<typename T,
                 typename = std::enable_if_t<std::is_same_v<T, left_t> && std::is_default_constructible_v<right_t>>>
         const left_t& at_right_or_default(const T& key) {
-            if (right_tree.find(key) != nullptr) {
-                return *right_iterator(this, right_tree.find_place(key)).flip();
+            if (right_node_t* node_ptr = right_tree.find(key); node_ptr != nullptr) {
+                return *right_iterator(this, node_ptr).flip();
             } else {
                 left_t default_left = left_t();
                 if (find_left(default_left) != end_left()) {
@@ -674,70 +1943,179 @@ namespace bmp {
 
         // не меньше
         left_iterator lower_bound_left(const left_t& left) const {
-            left_node_t* find_res = left_tree.find_place(left);
-            if (!left_cmp(find_res->get_value(), left)) {
-                return left_iterator(this, find_res);
-            } else {
-                if (find_res->next == nullptr) {
-                    return end_left();
-                } else {
-                    return left_iterator(this, find_res->next);
-                }
-            }
+            static_assert(left_tree_t::is_ordered, "lower_bound_left needs an ordered left side");
+            return left_iterator(this, left_tree.lower_bound(left));
+        }
+
+        template<typename K, typename = enable_if_transparent_t<K, CompareLeft, left_iterator>>
+        left_iterator lower_bound_left(const K& left) const {
+            static_assert(left_tree_t::is_ordered, "lower_bound_left needs an ordered left side");
+            return left_iterator(this, left_tree.lower_bound(left));
         }
 
         // больше
         left_iterator upper_bound_left(const left_t& left) const {
-            left_node_t* find_res = left_tree.find_place(left);
-            if (left_cmp(left, find_res->get_value())) {
-                return left_iterator(this, find_res);
-            } else if (!left_cmp(left, find_res->get_value()) && !left_cmp(find_res->get_value(), left)) {
-                if (find_res->next == nullptr) {
-                    return end_left();
-                } else {
-                    return left_iterator(this, find_res);
-                }
-            } else {
-                if (find_res->next == nullptr) {
-                    return end_left();
-                } else {
-                    return left_iterator(this, find_res->next);
-                }
-            }
+            static_assert(left_tree_t::is_ordered, "upper_bound_left needs an ordered left side");
+            return left_iterator(this, left_tree.upper_bound(left));
+        }
+
+        template<typename K, typename = enable_if_transparent_t<K, CompareLeft, left_iterator>>
+        left_iterator upper_bound_left(const K& left) const {
+            static_assert(left_tree_t::is_ordered, "upper_bound_left needs an ordered left side");
+            return left_iterator(this, left_tree.upper_bound(left));
         }
 
         // не меньше
         right_iterator lower_bound_right(const right_t& right) const {
-            right_node_t* find_res = right_tree.find_place(right);
-            if (!right_cmp(find_res->get_value(), right)) {
-                return right_iterator(this, find_res);
-            } else {
-                if (find_res->next == nullptr) {
-                    return end_right();
-                } else {
-                    return right_iterator(this, find_res->next);
-                }
-            }
+            static_assert(right_tree_t::is_ordered, "lower_bound_right needs an ordered right side");
+            return right_iterator(this, right_tree.lower_bound(right));
+        }
+
+        template<typename K, typename = enable_if_transparent_t<K, CompareRight, right_iterator>>
+        right_iterator lower_bound_right(const K& right) const {
+            static_assert(right_tree_t::is_ordered, "lower_bound_right needs an ordered right side");
+            return right_iterator(this, right_tree.lower_bound(right));
         }
 
         // больше
         right_iterator upper_bound_right(const right_t& right) const {
-            right_node_t* find_res = right_tree.find_place(right);
-            if (right_cmp(right, find_res->get_value())) {
-                return right_iterator(this, find_res);
-            } else if (!right_cmp(right, find_res->get_value()) && !right_cmp(find_res->get_value(), right)) {
-                if (find_res->next == nullptr) {
-                    return end_right();
-                } else {
-                    return right_iterator(this, find_res);
+            static_assert(right_tree_t::is_ordered, "upper_bound_right needs an ordered right side");
+            return right_iterator(this, right_tree.upper_bound(right));
+        }
+
+        template<typename K, typename = enable_if_transparent_t<K, CompareRight, right_iterator>>
+        right_iterator upper_bound_right(const K& right) const {
+            static_assert(right_tree_t::is_ordered, "upper_bound_right needs an ordered right side");
+            return right_iterator(this, right_tree.upper_bound(right));
+        }
+
+        // Order statistics with the subtree sizes kept in the nodes: O(log n) with
+        // red_black, treap and simd_btree sides, amortized O(log n) with
+        // splay_on_access. A splay side that does not splay on access keeps the
+        // shape its writes gave it, so these cost the depth of the node, up to O(n)
+        // after sorted inserts.
+        left_iterator nth_left(std::size_t k) const {
+            static_assert(left_tree_t::is_ordered, "nth_left needs an ordered left side");
+            return left_iterator(this, left_tree.nth(k));
+        }
+
+        right_iterator nth_right(std::size_t k) const {
+            static_assert(right_tree_t::is_ordered, "nth_right needs an ordered right side");
+            return right_iterator(this, right_tree.nth(k));
+        }
+
+        // Number of left values that are less than left.
+        [[nodiscard]] std::size_t rank_left(const left_t& left) const {
+            static_assert(left_tree_t::is_ordered, "rank_left needs an ordered left side");
+            return left_tree.rank(left);
+        }
+
+        template<typename K, typename = enable_if_transparent_t<K, CompareLeft, left_iterator>>
+        [[nodiscard]] std::size_t rank_left(const K& left) const {
+            static_assert(left_tree_t::is_ordered, "rank_left needs an ordered left side");
+            return left_tree.rank(left);
+        }
+
+        [[nodiscard]] std::size_t rank_right(const right_t& right) const {
+            static_assert(right_tree_t::is_ordered, "rank_right needs an ordered right side");
+            return right_tree.rank(right);
+        }
+
+        template<typename K, typename = enable_if_transparent_t<K, CompareRight, right_iterator>>
+        [[nodiscard]] std::size_t rank_right(const K& right) const {
+            static_assert(right_tree_t::is_ordered, "rank_right needs an ordered right side");
+            return right_tree.rank(right);
+        }
+
+        // Position of the pair in its order, size() for the end iterators.
+        [[nodiscard]] std::size_t index_of(left_iterator it) const {
+            static_assert(left_tree_t::is_ordered, "index_of needs an ordered side");
+            return (it.node == nullptr) ? size() : left_tree.rank_of(it.node);
+        }
+
+        [[nodiscard]] std::size_t index_of(right_iterator it) const {
+            static_assert(right_tree_t::is_ordered, "index_of needs an ordered side");
+            return (it.node == nullptr) ? size() : right_tree.rank_of(it.node);
+        }
+
+        // Number of left values in [low, high).
+        [[nodiscard]] std::size_t count_range_left(const left_t& low, const left_t& high) const {
+            static_assert(left_tree_t::is_ordered, "count_range_left needs an ordered left side");
+            return left_cmp(low, high) ? left_tree.rank(high) - left_tree.rank(low) : 0;
+        }
+
+        template<typename K, typename = enable_if_transparent_t<K, CompareLeft, left_iterator>>
+        [[nodiscard]] std::size_t count_range_left(const K& low, const K& high) const {
+            static_assert(left_tree_t::is_ordered, "count_range_left needs an ordered left side");
+            return left_cmp(low, high) ? left_tree.rank(high) - left_tree.rank(low) : 0;
+        }
+
+        [[nodiscard]] std::size_t count_range_right(const right_t& low, const right_t& high) const {
+            static_assert(right_tree_t::is_ordered, "count_range_right needs an ordered right side");
+            return right_cmp(low, high) ? right_tree.rank(high) - right_tree.rank(low) : 0;
+        }
+
+        template<typename K, typename = enable_if_transparent_t<K, CompareRight, right_iterator>>
+        [[nodiscard]] std::size_t count_range_right(const K& low, const K& high) const {
+            static_assert(right_tree_t::is_ordered, "count_range_right needs an ordered right side");
+            return right_cmp(low, high) ? right_tree.rank(high) - right_tree.rank(low) : 0;
+        }
+
+        // k + 1 bounds of k consecutive ranges of the side whose sizes differ by at
+        // most one, [bounds[i], bounds[i + 1]), found with k calls of nth: O(k log n)
+        // on balanced sides, up to O(k n) on a splay side that does not splay on
+        // access (see nth_left).
+        std::vector<left_iterator> split_left(std::size_t k) const {
+            static_assert(left_tree_t::is_ordered, "split_left needs an ordered left side");
+            return split<left_iterator>(left_tree, k);
+        }
+
+        std::vector<right_iterator> split_right(std::size_t k) const {
+            static_assert(right_tree_t::is_ordered, "split_right needs an ordered right side");
+            return split<right_iterator>(right_tree, k);
+        }
+
+        // Parallel scans of the pairs in ranges from split_left, with up to
+        // thread_count threads (0 for one per hardware thread). The callbacks are
+        // called as f(left, right), concurrently, and must not modify the bimap.
+        template<class F>
+        void for_each_left(F f, std::size_t thread_count = 0) const {
+            for_each_range(thread_count, [&f](std::size_t, left_iterator first, left_iterator last) {
+                for (; first != last; ++first) {
+                    f(*first, *first.flip());
                 }
-            } else {
-                if (find_res->next == nullptr) {
-                    return end_right();
-                } else {
-                    return right_iterator(this, find_res->next);
+            });
+        }
+
+        template<class Predicate>
+        [[nodiscard]] std::size_t count_if(Predicate pred, std::size_t thread_count = 0) const {
+            return transform_reduce(std::size_t(0), std::plus<>(), [&pred](const left_t& left, const right_t& right) {
+                return pred(left, right) ? std::size_t(1) : std::size_t(0);
+            }, thread_count);
+        }
+
+        // Folds transform(left, right) of all pairs into init with reduce, which must
+        // be associative: each range is folded on its own and the results of the
+        // ranges are folded in left order.
+        template<class T, class Reduce, class Transform>
+        T transform_reduce(T init, Reduce reduce, Transform transform, std::size_t thread_count = 0) const {
+            std::vector<std::optional<T>> partial(chunk_count(size(), resolve_thread_count(thread_count)));
+            for_each_range(thread_count, [&](std::size_t chunk, left_iterator first, left_iterator last) {
+                std::optional<T>& result = partial[chunk];
+                for (; first != last; ++first) {
+                    if (result) {
+                        result = reduce(std::move(*result), transform(*first, *first.flip()));
+                    } else {
+                        result = transform(*first, *first.flip());
+                    }
+                }
+            });
+            for (std::optional<T>& result : partial) {
+                if (result) {
+                    init = reduce(std::move(init), std::move(*result));
                 }
             }
+            return init;
         }
 
         left_iterator begin_left() const {
@@ -764,20 +2142,43 @@ namespace bmp {
             return size() == 0;
         }
 
+        // Frees the nodes in left order along the threads, so the stack use does not
+        // depend on the depth of the trees.
+        void clear() {
+            left_node_t* cur = left_tree.get_first_node();
+            while (cur != nullptr) {
+                left_node_t* next = cur->next;
+                destroy_node(static_cast<double_node_t*>(cur));
+                cur = next;
+            }
+            left_tree.detach_all();
+            right_tree.detach_all();
+            bimap_size = 0;
+        }
+
         friend bool operator==(const bimap& a, const bimap& b) {
             if (a.size() != b.size()) {
                 return false;
             }
 
+            if constexpr (!left_tree_t::is_ordered) {
+                for (auto it = a.begin_left(); it != a.end_left(); ++it) {
+                    left_node_t* other = b.left_tree.find(*it);
+                    if (other == nullptr ||
+                        !a.right_tree.equivalent(right_value(static_cast<double_node_t*>(other)), *it.flip())) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
             auto first_left_it = a.begin_left();
             auto second_left_it = b.begin_left();
 
             while (first_left_it != a.end_left() &&
                    second_left_it != b.end_left()) {
-                if (a.left_cmp(*first_left_it, *second_left_it) ||
-                    a.left_cmp(*second_left_it, *first_left_it) ||
-                    b.right_cmp(*first_left_it.flip(), *second_left_it.flip()) ||
-                    b.right_cmp(*second_left_it.flip(), *first_left_it.flip())) {
+                if (!a.left_tree.equivalent(*first_left_it, *second_left_it) ||
+                    !b.right_tree.equivalent(*first_left_it.flip(), *second_left_it.flip())) {
                     return false;
                 }
                 ++first_left_it;
@@ -792,27 +2193,599 @@ namespace bmp {
         }
 
     private:
-        void subtree_deleter(left_node_t* cur_root) {
-            if (cur_root != nullptr) {
-                subtree_deleter(cur_root->left);
-                subtree_deleter(cur_root->right);
+        // Open-addressing map from the nodes of a copied bimap to their copies.
+        class node_translation {
+        public:
+            explicit node_translation(std::size_t count) {
+                std::size_t capacity = 2;
+                while (capacity < 2 * count) {
+                    capacity *= 2;
+                }
+                slots.resize(capacity, {nullptr, nullptr});
+                mask = capacity - 1;
+            }
 
-                delete static_cast<double_node_t*>(cur_root);
+            void insert(const double_node_t* original, double_node_t* copy) {
+                std::size_t i = slot(original);
+                while (slots[i].first != nullptr) {
+                    i = (i + 1) & mask;
+                }
+                slots[i] = {original, copy};
             }
+
+            double_node_t* find(const double_node_t* original) const {
+                if (original == nullptr) {
+                    return nullptr;
+                }
+                std::size_t i = slot(original);
+                while (slots[i].first != original) {
+                    i = (i + 1) & mask;
+                }
+                return slots[i].second;
+            }
+
+            template<class F>
+            void for_each_copy(F f) const {
+                for (const auto& entry : slots) {
+                    if (entry.second != nullptr) {
+                        f(entry.second);
+                    }
+                }
+            }
+
+        private:
+            std::size_t slot(const double_node_t* node) const {
+                auto bits = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(node));
+                return static_cast<std::size_t>((bits >> 4) * 0x9E3779B97F4A7C15ull >> 20) & mask;
+            }
+
+            std::vector<std::pair<const double_node_t*, double_node_t*>> slots;
+            std::size_t mask;
+        };
+
+        // node_translation that several threads fill at once; it is read only after
+        // all of them are done.
+        class concurrent_node_translation {
+        public:
+            explicit concurrent_node_translation(std::size_t count) {
+                std::size_t capacity = 2;
+                while (capacity < 2 * count) {
+                    capacity *= 2;
+                }
+                originals = std::vector<std::atomic<const double_node_t*>>(capacity);
+                copies.resize(capacity, nullptr);
+                mask = capacity - 1;
+            }
+
+            void insert(const double_node_t* original, double_node_t* copy) {
+                for (std::size_t i = slot(original);; i = (i + 1) & mask) {
+                    const double_node_t* expected = nullptr;
+                    if (originals[i].load(std::memory_order_relaxed) == nullptr &&
+                        originals[i].compare_exchange_strong(expected, original, std::memory_order_relaxed)) {
+                        copies[i] = copy;
+                        return;
+                    }
+                }
+            }
+
+            double_node_t* find(const double_node_t* original) const {
+                std::size_t i = slot(original);
+                while (originals[i].load(std::memory_order_relaxed) != original) {
+                    i = (i + 1) & mask;
+                }
+                return copies[i];
+            }
+
+        private:
+            std::size_t slot(const double_node_t* node) const {
+                auto bits = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(node));
+                return static_cast<std::size_t>((bits >> 4) * 0x9E3779B97F4A7C15ull >> 20) & mask;
+            }
+
+            std::vector<std::atomic<const double_node_t*>> originals;
+            std::vector<double_node_t*> copies;
+            std::size_t mask;
+        };
+
+        static const left_t& left_value(const double_node_t* node) {
+            return static_cast<const left_node_t*>(node)->get_value();
+        }
+
+        static const right_t& right_value(const double_node_t* node) {
+            return static_cast<const right_node_t*>(node)->get_value();
+        }
+
+        static const right_t& right_at(left_node_t* found) {
+            if (found == nullptr) {
+                throw std::out_of_range("Bimap does not contains left key");
+            }
+            return right_value(static_cast<double_node_t*>(found));
+        }
+
+        static const left_t& left_at(right_node_t* found) {
+            if (found == nullptr) {
+                throw std::out_of_range("Bimap does not contains right key");
+            }
+            return left_value(static_cast<double_node_t*>(found));
+        }
+
+        template<class It>
+        static constexpr bool is_forward_iterator_v =
+                std::is_base_of_v<std::forward_iterator_tag, typename std::iterator_traits<It>::iterator_category>;
+
+        // First left node that is not less than key. `from` is where the previous
+        // key of a batch was found; when it is not greater than key, the search
+        // starts there instead of at the root.
+        template<class K>
+        left_node_t* seek_left(left_node_t* from, const K& key) const {
+            if (from != nullptr && !left_cmp(key, from->get_value())) {
+                return left_tree.lower_bound_from(from, key);
+            }
+            return left_tree.lower_bound(key);
+        }
+
+        // insert_batch for pairs with strictly increasing left values: the new pairs
+        // are merged with the pairs of both trees, which are then rebuilt from the
+        // merged sequences. Existing pairs win all conflicts, new pairs with the same
+        // right value are taken in batch order, as by repeated insert.
+        template<class ForwardIt>
+        std::vector<bool> merge_sorted_batch(ForwardIt first, ForwardIt last, std::size_t count) {
+            std::vector<bool> inserted(count, false);
+            std::vector<std::pair<double_node_t*, std::size_t>> fresh;
+            std::vector<double_node_t*> left_order;
+            std::vector<double_node_t*> right_order;
+            try {
+                fresh.reserve(count);
+                left_node_t* cur = left_tree.get_first_node();
+                std::size_t index = 0;
+                for (; first != last; ++first, ++index) {
+                    auto&& pair = *first;
+                    while (cur != nullptr && left_cmp(cur->get_value(), pair.first)) {
+                        cur = cur->next;
+                    }
+                    if (cur == nullptr || left_cmp(pair.first, cur->get_value())) {
+                        fresh.emplace_back(create_node(std::forward<decltype(pair)>(pair).first,
+                                                       std::forward<decltype(pair)>(pair).second), index);
+                    }
+                }
+
+                std::vector<std::size_t> by_right(fresh.size());
+                for (std::size_t i = 0; i < by_right.size(); i++) {
+                    by_right[i] = i;
+                }
+                std::stable_sort(by_right.begin(), by_right.end(), [this, &fresh](std::size_t a, std::size_t b) {
+                    return right_cmp(right_value(fresh[a].first), right_value(fresh[b].first));
+                });
+
+                right_order.reserve(size() + fresh.size());
+                right_node_t* right_cur = right_tree.get_first_node();
+                const double_node_t* last_fresh = nullptr;
+                for (std::size_t i : by_right) {
+                    double_node_t* node = fresh[i].first;
+                    while (right_cur != nullptr && right_cmp(right_cur->get_value(), right_value(node))) {
+                        right_order.push_back(static_cast<double_node_t*>(right_cur));
+                        right_cur = right_cur->next;
+                    }
+                    bool taken = (right_cur != nullptr && !right_cmp(right_value(node), right_cur->get_value())) ||
+                                 (last_fresh != nullptr && !right_cmp(right_value(last_fresh), right_value(node)));
+                    if (taken) {
+                        destroy_node(node);
+                        fresh[i].first = nullptr;
+                    } else {
+                        right_order.push_back(node);
+                        last_fresh = node;
+                    }
+                }
+                for (; right_cur != nullptr; right_cur = right_cur->next) {
+                    right_order.push_back(static_cast<double_node_t*>(right_cur));
+                }
+
+                left_order.reserve(right_order.size());
+                left_node_t* left_cur = left_tree.get_first_node();
+                for (auto& [node, batch_index] : fresh) {
+                    if (node == nullptr) {
+                        continue;
+                    }
+                    while (left_cur != nullptr && left_cmp(left_cur->get_value(), left_value(node))) {
+                        left_order.push_back(static_cast<double_node_t*>(left_cur));
+                        left_cur = left_cur->next;
+                    }
+                    left_order.push_back(node);
+                    inserted[batch_index] = true;
+                }
+                for (; left_cur != nullptr; left_cur = left_cur->next) {
+                    left_order.push_back(static_cast<double_node_t*>(left_cur));
+                }
+            } catch (...) {
+                for (auto& [node, batch_index] : fresh) {
+                    if (node != nullptr) {
+                        destroy_node(node);
+                    }
+                }
+                throw;
+            }
+
+            rebuild(left_order, right_order);
+            return inserted;
+        }
+
+        // erase_left_batch for sorted keys: one merge-like pass over the left thread,
+        // then both trees are rebuilt from the remaining pairs.
+        template<class ForwardIt>
+        std::vector<bool> erase_sorted_batch(ForwardIt first, ForwardIt last, std::size_t count) {
+            std::vector<bool> erased(count, false);
+            std::vector<double_node_t*> doomed;
+            left_node_t* cur = left_tree.get_first_node();
+            std::size_t index = 0;
+            for (; first != last; ++first, ++index) {
+                while (cur != nullptr && left_cmp(cur->get_value(), *first)) {
+                    cur = cur->next;
+                }
+                if (cur != nullptr && !left_cmp(*first, cur->get_value())) {
+                    doomed.push_back(static_cast<double_node_t*>(cur));
+                    erased[index] = true;
+                    cur = cur->next;
+                }
+            }
+            if (doomed.empty()) {
+                return erased;
+            }
+
+            // a zero size marks the doomed nodes; rebuild recomputes all sizes
+            for (double_node_t* node : doomed) {
+                static_cast<left_node_t*>(node)->set_size(0);
+            }
+            std::vector<double_node_t*> left_order;
+            std::vector<double_node_t*> right_order;
+            left_order.reserve(size() - doomed.size());
+            right_order.reserve(size() - doomed.size());
+            for (left_node_t* node = left_tree.get_first_node(); node != nullptr; node = node->next) {
+                if (node->get_size() != 0) {
+                    left_order.push_back(static_cast<double_node_t*>(node));
+                }
+            }
+            for (right_node_t* node = right_tree.get_first_node(); node != nullptr; node = node->next) {
+                auto* double_node_ptr = static_cast<double_node_t*>(node);
+                if (static_cast<left_node_t*>(double_node_ptr)->get_size() != 0) {
+                    right_order.push_back(double_node_ptr);
+                }
+            }
+
+            rebuild(left_order, right_order);
+            for (double_node_t* node : doomed) {
+                destroy_node(node);
+            }
+            return erased;
+        }
+
+        template<class Iterator, class Tree>
+        std::vector<Iterator> split(const Tree& tree, std::size_t k) const {
+            k = std::max<std::size_t>(k, 1);
+            std::vector<Iterator> bounds;
+            bounds.reserve(k + 1);
+            for (std::size_t i = 0; i < k; i++) {
+                bounds.push_back(Iterator(this, tree.nth(size() * i / k)));
+            }
+            bounds.push_back(Iterator(this, nullptr));
+            return bounds;
+        }
+
+        // Calls f(i, first, last) for the ranges of split_left on separate threads,
+        // one range per thread.
+        template<class F>
+        void for_each_range(std::size_t thread_count, F f) const {
+            std::vector<left_iterator> bounds = split_left(chunk_count(size(), resolve_thread_count(thread_count)));
+            run_parallel(bounds.size() - 1, [&](std::size_t i) {
+                f(i, bounds[i], bounds[i + 1]);
+            });
+        }
+
+        // Relinks all pairs of the bimap from their sequences in both orders.
+        void rebuild(std::vector<double_node_t*>& left_order, std::vector<double_node_t*>& right_order) {
+            left_tree.detach_all();
+            right_tree.detach_all();
+            build_trees(left_order, right_order, 1);
+        }
+
+        // Builds both (empty) trees from the pairs in both orders; with more than
+        // one thread the trees are built side by side, with half of them each.
+        void build_trees(std::vector<double_node_t*>& left_order, std::vector<double_node_t*>& right_order,
+                         std::size_t thread_count) {
+            assert(left_order.size() == right_order.size());
+            if (thread_count > 1) {
+                std::size_t half = (thread_count + 1) / 2;
+                run_parallel(2, [&](std::size_t i) {
+                    if (i == 0) {
+                        left_tree.build_sorted(left_order.begin(), left_order.end(), half);
+                    } else {
+                        right_tree.build_sorted(right_order.begin(), right_order.end(), thread_count - half);
+                    }
+                });
+            } else {
+                left_tree.build_sorted(left_order.begin(), left_order.end());
+                right_tree.build_sorted(right_order.begin(), right_order.end());
+            }
+            bimap_size = left_order.size();
+        }
+
+        template<class Iterator, class Index, class InputIt>
+        std::vector<Iterator> find_interleaved(const Index& index, InputIt first, InputIt last) const {
+            std::vector<typename Index::node_t*> nodes;
+            if constexpr (std::is_base_of_v<std::random_access_iterator_tag,
+                                            typename std::iterator_traits<InputIt>::iterator_category>) {
+                nodes.resize(static_cast<std::size_t>(last - first));
+                index.find_interleaved(first, nodes.size(), nodes.data());
+            } else {
+                std::vector<typename std::iterator_traits<InputIt>::value_type> keys(first, last);
+                nodes.resize(keys.size());
+                index.find_interleaved(keys.begin(), nodes.size(), nodes.data());
+            }
+
+            std::vector<Iterator> found;
+            found.reserve(nodes.size());
+            for (auto* node : nodes) {
+                found.emplace_back(this, node);
+            }
+            return found;
+        }
+
+        // Links a detached node unless one of its values is taken; returns the pair
+        // that blocked it otherwise, like try_insert.
+        std::pair<left_iterator, bool> link_node(double_node_t* node) {
+            reserve_for_insert();
+            auto left_pos = left_tree.find_position(left_value(node));
+            if (left_pos.found) {
+                return {left_iterator(this, left_pos.place), false};
+            }
+            auto right_pos = right_tree.find_position(right_value(node));
+            if (right_pos.found) {
+                return {right_iterator(this, right_pos.place).flip(), false};
+            }
+
+            left_tree.insert_at(left_pos, node);
+            right_tree.insert_at(right_pos, node);
+            ++bimap_size;
+
+            return {left_iterator(this, node), true};
+        }
+
+        void unlink_node(double_node_t* node) {
+            left_tree.erase_node(node);
+            right_tree.erase_node(node);
+            --bimap_size;
+        }
+
+        template<typename Node>
+        node_type extract_found(Node* found) {
+            auto* double_node_ptr = static_cast<double_node_t*>(found);
+            unlink_node(double_node_ptr);
+            return node_type(double_node_ptr, node_alloc);
+        }
+
+        // Erases the pair of a node found on either side, if there is one.
+        template<typename Node>
+        bool erase_found(Node* found) {
+            if (found == nullptr) {
+                return false;
+            }
+            auto* double_node_ptr = static_cast<double_node_t*>(found);
+            unlink_node(double_node_ptr);
+            destroy_node(double_node_ptr);
+
+            return true;
+        }
+
+        // Links nodes that are strictly increasing by left value into both indices,
+        // dropping (and freeing) the ones whose right value repeats an earlier one.
+        // Ordered right sides are sorted and both trees built with up to
+        // thread_count threads.
+        void build_from_sorted_nodes(std::vector<double_node_t*>& nodes, std::size_t thread_count = 1) {
+            if constexpr (!right_tree_t::is_ordered) {
+                right_tree.reserve(nodes.size());
+                for (double_node_t*& node : nodes) {
+                    auto pos = right_tree.find_position(right_value(node));
+                    if (pos.found) {
+                        destroy_node(node);
+                        node = nullptr;
+                    } else {
+                        right_tree.insert_at(pos, node);
+                    }
+                }
+                nodes.erase(std::remove(nodes.begin(), nodes.end(), nullptr), nodes.end());
+
+                left_tree.build_sorted(nodes.begin(), nodes.end(), thread_count);
+                bimap_size = nodes.size();
+            } else {
+                std::vector<std::pair<double_node_t*, std::size_t>> by_right(nodes.size());
+                parallel_chunks(nodes.size(), thread_count, [&](std::size_t begin, std::size_t end) {
+                    for (std::size_t i = begin; i < end; i++) {
+                        by_right[i] = {nodes[i], i};
+                    }
+                });
+                parallel_stable_sort(by_right.begin(), by_right.end(), [this](const auto& a, const auto& b) {
+                    return right_cmp(right_value(a.first), right_value(b.first));
+                }, thread_count);
+
+                std::vector<double_node_t*> right_order;
+                right_order.reserve(nodes.size());
+                for (const auto& [node, index] : by_right) {
+                    if (!right_order.empty() && !right_cmp(right_value(right_order.back()), right_value(node))) {
+                        destroy_node(node);
+                        nodes[index] = nullptr;
+                    } else {
+                        right_order.push_back(node);
+                    }
+                }
+                nodes.erase(std::remove(nodes.begin(), nodes.end(), nullptr), nodes.end());
+
+                build_trees(nodes, right_order, thread_count);
+            }
+        }
+
+        // Copies the pairs of other (this bimap is empty) and gives both trees its
+        // shapes.
+        void copy_links(const bimap& other) {
+            node_translation translation(other.size());
+            try {
+                for (left_node_t* cur = other.left_tree.get_first_node(); cur != nullptr; cur = cur->next) {
+                    auto* old_node = static_cast<const double_node_t*>(cur);
+                    translation.insert(old_node, create_node(left_value(old_node), right_value(old_node)));
+                }
+
+                // a side that is rebuilt instead of cloned needs memory for its nodes
+                left_tree.clone_links(other.left_tree, [&translation](const left_node_t* node) {
+                    return static_cast<left_node_t*>(translation.find(static_cast<const double_node_t*>(node)));
+                });
+                right_tree.clone_links(other.right_tree, [&translation](const right_node_t* node) {
+                    return static_cast<right_node_t*>(translation.find(static_cast<const double_node_t*>(node)));
+                });
+            } catch (...) {
+                left_tree.detach_all();
+                right_tree.detach_all();
+                translation.for_each_copy([this](double_node_t* node) { destroy_node(node); });
+                throw;
+            }
+            bimap_size = other.bimap_size;
+        }
+
+        // Pairs of other in both orders are read in chunks on separate threads, the
+        // copies of the right order are found in a translation that all threads
+        // fill at once. One chunk is copied by copy_links. The chunks start at nodes
+        // found with nth, which costs their depth on splay sides (see nth_left).
+        void copy_parallel(const bimap& other, std::size_t thread_count) {
+            std::size_t n = other.size();
+            if (chunk_count(n, thread_count) == 1) {
+                copy_links(other);
+                return;
+            }
+            std::vector<const double_node_t*> originals(n);
+            std::vector<double_node_t*> left_order(n, nullptr);
+            std::vector<double_node_t*> right_order(n);
+            std::size_t chunks = chunk_count(n, thread_count);
+            std::vector<const left_node_t*> left_starts(chunks);
+            std::vector<const right_node_t*> right_starts(chunks);
+            for (std::size_t c = 0; c < chunks; c++) {
+                left_starts[c] = other.left_tree.nth(n * c / chunks);
+                right_starts[c] = other.right_tree.nth(n * c / chunks);
+            }
+
+            run_parallel(chunks, [&](std::size_t c) {
+                const left_node_t* cur = left_starts[c];
+                for (std::size_t i = n * c / chunks; i < n * (c + 1) / chunks; i++, cur = cur->next) {
+                    originals[i] = static_cast<const double_node_t*>(cur);
+                }
+            });
+            try {
+                create_nodes(n, thread_count, [&](std::size_t i) {
+                    return create_node(left_value(originals[i]), right_value(originals[i]));
+                }, left_order.data());
+
+                concurrent_node_translation translation(n);
+                parallel_chunks(n, thread_count, [&](std::size_t begin, std::size_t end) {
+                    for (std::size_t i = begin; i < end; i++) {
+                        translation.insert(originals[i], left_order[i]);
+                    }
+                });
+                run_parallel(chunks, [&](std::size_t c) {
+                    const right_node_t* cur = right_starts[c];
+                    for (std::size_t i = n * c / chunks; i < n * (c + 1) / chunks; i++, cur = cur->next) {
+                        right_order[i] = translation.find(static_cast<const double_node_t*>(cur));
+                    }
+                });
+
+                build_trees(left_order, right_order, thread_count);
+            } catch (...) {
+                for (double_node_t* node : left_order) {
+                    if (node != nullptr) {
+                        destroy_node(node);
+                    }
+                }
+                left_tree.detach_all();
+                right_tree.detach_all();
+                bimap_size = 0;
+                throw;
+            }
+        }
+
+        // Fills nodes[0, count) with create(i), in parallel chunks if nodes are
+        // allocated with std::allocator, whose allocations may run concurrently.
+        // On an exception the nodes created so far are in nodes, the others are
+        // nullptr.
+        template<class Create>
+        void create_nodes(std::size_t count, std::size_t thread_count, Create create, double_node_t** nodes) {
+            if constexpr (!std::is_same_v<node_allocator_t, std::allocator<double_node_t>>) {
+                thread_count = 1;
+            }
+            parallel_chunks(count, thread_count, [&](std::size_t begin, std::size_t end) {
+                for (std::size_t i = begin; i < end; i++) {
+                    nodes[i] = create(i);
+                }
+            });
+        }
+
+        template<class... Args>
+        double_node_t* create_node(Args&&... args) {
+            double_node_t* node = node_traits::allocate(node_alloc, 1);
+            try {
+                node_traits::construct(node_alloc, node, std::forward<Args>(args)...);
+            } catch (...) {
+                node_traits::deallocate(node_alloc, node, 1);
+                throw;
+            }
+            return node;
+        }
+
+        void destroy_node(double_node_t* node) {
+            node_traits::destroy(node_alloc, node);
+            node_traits::deallocate(node_alloc, node, 1);
+        }
+
+        void swap_contents(bimap& other) noexcept {
+            std::swap(bimap_size, other.bimap_size);
+
+            swap(left_tree, other.left_tree);
+            swap(right_tree, other.right_tree);
+
+            std::swap(left_cmp, other.left_cmp);
+            std::swap(right_cmp, other.right_cmp);
+        }
+
+        // Grows hashed sides for one more pair and gives B-tree sides their split
+        // blocks before positions are looked up (a rehash moves them), so that
+        // linking a node into both sides can not throw halfway.
+        void reserve_for_insert() {
+            left_tree.reserve(size() + 1);
+            right_tree.reserve(size() + 1);
         }
 
         template <class L, class R>
         left_iterator basic_insert(L&& left, R&& right) {
-            if (left_tree.find(left) != nullptr || right_tree.find(right) != nullptr) {
-                return end_left();
-            } else {
-                auto* new_double_node = new double_node_t(std::forward<L>(left), std::forward<R>(right));
-                left_tree.insert(new_double_node);
-                right_tree.insert(new_double_node);
-                ++bimap_size;
+            auto result = basic_try_insert(nullptr, std::forward<L>(left), std::forward<R>(right));
+            return result.second ? result.first : end_left();
+        }
+
+        template <class L, class R>
+        std::pair<left_iterator, bool> basic_try_insert(const left_iterator* hint, L&& left, R&& right) {
+            reserve_for_insert();
+            auto left_pos = (hint == nullptr) ? left_tree.find_position(left)
+                                              : left_tree.find_position(hint->node, left);
+            if (left_pos.found) {
+                return {left_iterator(this, left_pos.place), false};
+            }
 
-                return {this, new_double_node};
+            auto right_pos = right_tree.find_position(right);
+            if (right_pos.found) {
+                return {right_iterator(this, right_pos.place).flip(), false};
             }
+
+            auto* new_double_node = create_node(std::piecewise_construct,
+                                                std::forward_as_tuple(std::forward<L>(left)),
+                                                std::forward_as_tuple(std::forward<R>(right)));
+            left_tree.insert_at(left_pos, new_double_node);
+            right_tree.insert_at(right_pos, new_double_node);
+            ++bimap_size;
+
+            return {left_iterator(this, new_double_node), true};
         }
 
         left_tree_t left_tree;
@@ -821,6 +2794,37 @@ namespace bmp {
         CompareLeft left_cmp;
         CompareRight right_cmp;
 
+        node_allocator_t node_alloc;
+
         std::size_t bimap_size = 0;
     };
-}
\ No newline at end of file
+
+    // Bimap with hash indices on both sides: O(1) expected lookups, pairs are
+    // iterated in insertion order.
+    template<typename Left,
+            typename Right,
+            typename HashLeft = std::hash<Left>,
+            typename HashRight = std::hash<Right>,
+            typename EqualLeft = std::equal_to<Left>,
+            typename EqualRight = std::equal_to<Right>,
+            typename Allocator = std::allocator<std::pair<Left, Right>>>
+    using unordered_bimap = bimap<Left, Right, hashed<HashLeft, EqualLeft>, hashed<HashRight, EqualRight>, Allocator>;
+
+    // Bimap of arithmetic values with B+-tree indices searched by SIMD compares on
+    // both sides, see btree_index.
+    template<typename Left,
+            typename Right,
+            typename CompareLeft = std::less<Left>,
+            typename CompareRight = std::less<Right>,
+            typename Allocator = std::allocator<std::pair<Left, Right>>>
+    using simd_bimap = bimap<Left, Right, ordered<CompareLeft, simd_btree>, ordered<CompareRight, simd_btree>, Allocator>;
+
+    namespace pmr {
+        template<typename Left,
+                typename Right,
+                typename CompareLeft = std::less<Left>,
+                typename CompareRight = std::less<Right>>
+        using bimap = bmp::bimap<Left, Right, CompareLeft, CompareRight,
+                std::pmr::polymorphic_allocator<std::pair<Left, Right>>>;
+    }
+}
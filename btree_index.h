@@ -0,0 +1,790 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#endif
+
+namespace bmp {
+    template<class T, class Tag>
+    class base_node;
+
+    // Balancing marker for ordered<Cmp, simd_btree>: the side is indexed by a
+    // btree_index instead of a binary tree. Only for arithmetic values ordered by
+    // std::less or std::greater.
+    struct simd_btree {
+        static constexpr bool restructures_on_access = false;
+    };
+
+    // Maps arithmetic values to signed integers of the same size whose order is the
+    // order of Cmp, so that keys of every type are compared by the same integer
+    // instructions. -0.0 and 0.0 get the same key, as they are equivalent for
+    // std::less; NaNs are not ordered by std::less and are not supported.
+    template<typename T, typename Cmp>
+    struct btree_key {
+        static_assert(std::is_arithmetic_v<T>, "simd_btree needs arithmetic values");
+        static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8,
+                      "simd_btree needs values of 1, 2, 4 or 8 bytes");
+        static_assert(std::is_same_v<Cmp, std::less<T>> || std::is_same_v<Cmp, std::greater<T>>,
+                      "simd_btree needs std::less or std::greater");
+
+        using type = std::conditional_t<sizeof(T) == 1, std::int8_t,
+                     std::conditional_t<sizeof(T) == 2, std::int16_t,
+                     std::conditional_t<sizeof(T) == 4, std::int32_t, std::int64_t>>>;
+        using bits_t = std::make_unsigned_t<type>;
+
+        static type of(T value) {
+            static constexpr bits_t sign = bits_t(1) << (8 * sizeof(T) - 1);
+            bits_t bits;
+            if constexpr (std::is_floating_point_v<T>) {
+                if (value == 0) {
+                    value = 0;
+                }
+                std::memcpy(&bits, &value, sizeof(T));
+                bits = (bits & sign) ? bits_t(~bits) : bits_t(bits | sign);
+                bits ^= sign;
+            } else if constexpr (std::is_signed_v<T>) {
+                bits = static_cast<bits_t>(value);
+            } else {
+                bits = static_cast<bits_t>(static_cast<bits_t>(value) ^ sign);
+            }
+            if constexpr (std::is_same_v<Cmp, std::greater<T>>) {
+                bits = static_cast<bits_t>(~bits);
+            }
+            return static_cast<type>(bits);
+        }
+    };
+
+    inline std::size_t popcount(unsigned bits) {
+#if defined(__GNUC__) || defined(__clang__)
+        return static_cast<std::size_t>(__builtin_popcount(bits));
+#else
+        std::size_t result = 0;
+        for (; bits != 0; bits &= bits - 1) {
+            ++result;
+        }
+        return result;
+#endif
+    }
+
+    // Number of keys[0, 16) that are less than key; keys is aligned to 64 bytes.
+    // A loop the compiler may vectorize, and the overloads below for x86-64.
+    template<class Key>
+    std::size_t count_less(const Key* keys, Key key) {
+        std::size_t result = 0;
+        for (std::size_t i = 0; i < 16; i++) {
+            result += static_cast<std::size_t>(keys[i] < key);
+        }
+        return result;
+    }
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    // The overloads for x86-64 use SSE2, which every x86-64 CPU has, and call the
+    // SSE4.2 and AVX2 versions if the CPU supports them. Those are compiled for
+    // their instruction sets by target attributes and picked at run time, so the
+    // definitions are the same whatever -m flags a translation unit is built with.
+    // Until the flags are initialized, e.g. by lookups from other static
+    // initializers, the SSE2 versions are used.
+    inline const bool cpu_has_sse42 = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse4.2") != 0;
+    }();
+
+    inline const bool cpu_has_avx2 = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+    }();
+
+    __attribute__((target("avx2")))
+    inline std::size_t count_less_avx2(const std::int32_t* keys, std::int32_t key) {
+        __m256i k = _mm256_set1_epi32(key);
+        __m256i low = _mm256_cmpgt_epi32(k, _mm256_load_si256(reinterpret_cast<const __m256i*>(keys)));
+        __m256i high = _mm256_cmpgt_epi32(k, _mm256_load_si256(reinterpret_cast<const __m256i*>(keys + 8)));
+        return popcount(static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(low)))) +
+               popcount(static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(high))));
+    }
+
+    __attribute__((target("avx2")))
+    inline std::size_t count_less_avx2(const std::int64_t* keys, std::int64_t key) {
+        __m256i k = _mm256_set1_epi64x(key);
+        unsigned mask = 0;
+        for (std::size_t i = 0; i < 4; i++) {
+            __m256i less = _mm256_cmpgt_epi64(k, _mm256_load_si256(reinterpret_cast<const __m256i*>(keys + 4 * i)));
+            mask |= static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(less))) << (4 * i);
+        }
+        return popcount(mask);
+    }
+
+    __attribute__((target("sse4.2")))
+    inline std::size_t count_less_sse42(const std::int64_t* keys, std::int64_t key) {
+        __m128i k = _mm_set1_epi64x(key);
+        unsigned mask = 0;
+        for (std::size_t i = 0; i < 8; i++) {
+            __m128i less = _mm_cmpgt_epi64(k, _mm_load_si128(reinterpret_cast<const __m128i*>(keys + 2 * i)));
+            mask |= static_cast<unsigned>(_mm_movemask_pd(_mm_castsi128_pd(less))) << (2 * i);
+        }
+        return popcount(mask);
+    }
+
+    inline std::size_t count_less(const std::int8_t* keys, std::int8_t key) {
+        __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(key), _mm_load_si128(reinterpret_cast<const __m128i*>(keys)));
+        return popcount(static_cast<unsigned>(_mm_movemask_epi8(less)));
+    }
+
+    inline std::size_t count_less(const std::int16_t* keys, std::int16_t key) {
+        __m128i k = _mm_set1_epi16(key);
+        __m128i low = _mm_cmpgt_epi16(k, _mm_load_si128(reinterpret_cast<const __m128i*>(keys)));
+        __m128i high = _mm_cmpgt_epi16(k, _mm_load_si128(reinterpret_cast<const __m128i*>(keys + 8)));
+        return popcount(static_cast<unsigned>(_mm_movemask_epi8(_mm_packs_epi16(low, high))));
+    }
+
+    inline std::size_t count_less(const std::int32_t* keys, std::int32_t key) {
+        if (cpu_has_avx2) {
+            return count_less_avx2(keys, key);
+        }
+        __m128i k = _mm_set1_epi32(key);
+        unsigned mask = 0;
+        for (std::size_t i = 0; i < 4; i++) {
+            __m128i less = _mm_cmpgt_epi32(k, _mm_load_si128(reinterpret_cast<const __m128i*>(keys + 4 * i)));
+            mask |= static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(less))) << (4 * i);
+        }
+        return popcount(mask);
+    }
+
+    inline std::size_t count_less(const std::int64_t* keys, std::int64_t key) {
+        if (cpu_has_avx2) {
+            return count_less_avx2(keys, key);
+        }
+        if (cpu_has_sse42) {
+            return count_less_sse42(keys, key);
+        }
+        return count_less<std::int64_t>(keys, key);
+    }
+#endif
+
+    // Index over the nodes of one ordered side of a bimap with arithmetic values,
+    // with the interface of tree. It is a B+-tree whose blocks hold 16 keys: a leaf
+    // the keys of up to 16 nodes in order, an inner block the greatest key and the
+    // size of up to 16 subtrees. A block is searched by counting its keys that are
+    // less than the key, 16 at a time with SIMD compares, and unused keys are the
+    // greatest key, so they are never counted. The threads of the nodes are kept
+    // like tree does; the other links of the nodes are not used.
+    //
+    // Blocks split when full; a block that drops below a quarter of its capacity
+    // is merged into a neighbour when they fit into one block.
+    template<typename T, typename Tag, typename Cmp>
+    class btree_index {
+    public:
+        using node_t = base_node<T, Tag>;
+        using balance_policy = simd_btree;
+
+        static constexpr bool is_ordered = true;
+        static constexpr bool restructures_on_access = false;
+
+        struct leaf_block;
+
+        // Result of one descent: the first node whose value is not less than the one
+        // searched for (nullptr if there is none), whether it is equivalent, and
+        // where a new node goes.
+        struct position {
+            base_node<T, Tag>* place = nullptr;
+            bool found = false;
+            leaf_block* leaf = nullptr;
+            std::size_t index = 0;
+        };
+
+        explicit btree_index(Cmp = Cmp()) {
+        }
+
+        btree_index(const btree_index&) = delete;
+        btree_index& operator=(const btree_index&) = delete;
+
+        ~btree_index() {
+            detach_all();
+        }
+
+        base_node<T, Tag>* get_first_node() const {
+            if (root == nullptr) {
+                return nullptr;
+            }
+            block* cur = root;
+            while (!cur->leaf) {
+                cur = as_inner(cur)->children[0];
+            }
+            return as_leaf(cur)->nodes[0];
+        }
+
+        base_node<T, Tag>* get_last_node() const {
+            if (root == nullptr) {
+                return nullptr;
+            }
+            block* cur = root;
+            while (!cur->leaf) {
+                cur = as_inner(cur)->children[cur->count - 1];
+            }
+            return as_leaf(cur)->nodes[cur->count - 1];
+        }
+
+        // The order is fixed by Cmp's type.
+        template<class Comparator>
+        void set_comparator(const Comparator&) {
+        }
+
+        void insert(base_node<T, Tag>* value_node) {
+            position pos = find_position(value_node->get_value());
+            if (!pos.found) {
+                insert_at(pos, value_node);
+            }
+        }
+
+        position find_position(const T& value) const {
+            position result;
+            if (root == nullptr) {
+                return result;
+            }
+            key_t key = key_of(value);
+            std::tie(result.leaf, result.index) = locate(key);
+            if (result.index < result.leaf->count) {
+                result.place = result.leaf->nodes[result.index];
+                result.found = result.leaf->keys[result.index] == key;
+            }
+            return result;
+        }
+
+        // A descent costs about as much as checking a hint.
+        position find_position(base_node<T, Tag>*, const T& value) const {
+            return find_position(value);
+        }
+
+        // Links value_node at a position returned by find_position for its value.
+        // The blocks a split needs are allocated before anything changes, or taken
+        // from the ones reserve() allocated, which makes insert_at nothrow.
+        void insert_at(const position& pos, base_node<T, Tag>* value_node) {
+            assert(!pos.found);
+            key_t key = key_of(value_node->get_value());
+            if (root == nullptr) {
+                reserve_blocks(0);
+                leaf_block* leaf = spare_leaf.release();
+                leaf->keys[0] = key;
+                leaf->nodes[0] = value_node;
+                leaf->count = 1;
+                root = leaf;
+                value_node->prev = value_node->next = nullptr;
+                return;
+            }
+
+            if (pos.leaf->count == width) {
+                std::size_t splits = 1;
+                for (inner_block* cur = pos.leaf->parent; cur == nullptr || cur->count == width; cur = cur->parent) {
+                    ++splits;
+                    if (cur == nullptr) {
+                        break;
+                    }
+                }
+                reserve_blocks(splits - 1);
+            }
+
+            base_node<T, Tag>* next = pos.place;
+            base_node<T, Tag>* prev = (next == nullptr) ? get_last_node() : next->prev;
+            value_node->prev = prev;
+            value_node->next = next;
+            if (prev != nullptr) {
+                prev->next = value_node;
+            }
+            if (next != nullptr) {
+                next->prev = value_node;
+            }
+
+            leaf_block* leaf = pos.leaf;
+            std::size_t index = pos.index;
+            if (leaf->count == width) {
+                leaf_block* upper = spare_leaf.release();
+                move_upper_half(leaf, upper);
+                insert_child(leaf, upper);
+                if (index >= leaf->count) {
+                    index -= leaf->count;
+                    leaf = upper;
+                }
+            }
+            insert_entry(leaf, index, key, value_node);
+            refresh(leaf);
+        }
+
+        // Allocates the blocks that the next insert_at may need, so that it can not
+        // throw: a leaf and an inner block per level. The count is there for the
+        // interface of hash_index::reserve; blocks are allocated one insert ahead.
+        void reserve(std::size_t) {
+            std::size_t levels = 0;
+            for (block* cur = root; cur != nullptr; cur = cur->leaf ? nullptr : as_inner(cur)->children[0]) {
+                ++levels;
+            }
+            reserve_blocks(levels);
+        }
+
+        void erase(const T& value) {
+            base_node<T, Tag>* node = find(value);
+            if (node != nullptr) {
+                erase_node(node);
+            }
+        }
+
+        void erase_node(base_node<T, Tag>* node) {
+            auto [leaf, index] = locate(key_of(node->get_value()));
+            assert(leaf->nodes[index] == node);
+            if (node->prev != nullptr) {
+                node->prev->next = node->next;
+            }
+            if (node->next != nullptr) {
+                node->next->prev = node->prev;
+            }
+            node->prev = node->next = nullptr;
+
+            remove_entry(leaf, index);
+            block* survivor = (leaf->count == 0) ? remove_block(leaf) : rebalance(leaf);
+            if (survivor != nullptr) {
+                refresh(survivor);
+            }
+            while (root != nullptr && !root->leaf && root->count == 1) {
+                block* child = as_inner(root)->children[0];
+                child->parent = nullptr;
+                delete as_inner(root);
+                root = child;
+            }
+        }
+
+        base_node<T, Tag>* find(const T& value) const {
+            position pos = find_position(value);
+            return pos.found ? pos.place : nullptr;
+        }
+
+        template<class RandomIt>
+        void find_interleaved(RandomIt keys, std::size_t count, base_node<T, Tag>** out) const {
+            for (std::size_t i = 0; i < count; i++) {
+                out[i] = find(*(keys + i));
+            }
+        }
+
+        base_node<T, Tag>* lower_bound(const T& value) const {
+            return find_position(value).place;
+        }
+
+        // A descent is cheap enough that the finger is not needed.
+        base_node<T, Tag>* lower_bound_from(base_node<T, Tag>*, const T& value) const {
+            return lower_bound(value);
+        }
+
+        base_node<T, Tag>* upper_bound(const T& value) const {
+            position pos = find_position(value);
+            return pos.found ? pos.place->next : pos.place;
+        }
+
+        [[nodiscard]] bool equivalent(const T& a, const T& b) const {
+            return key_of(a) == key_of(b);
+        }
+
+        [[nodiscard]] std::size_t size() const {
+            return root == nullptr ? 0 : size_of(root);
+        }
+
+        // k-th node in increasing order (from 0), nullptr if k >= size().
+        base_node<T, Tag>* nth(std::size_t k) const {
+            if (k >= size()) {
+                return nullptr;
+            }
+            block* cur = root;
+            while (!cur->leaf) {
+                inner_block* inner = as_inner(cur);
+                std::size_t i = 0;
+                while (k >= inner->sizes[i]) {
+                    k -= inner->sizes[i++];
+                }
+                cur = inner->children[i];
+            }
+            return as_leaf(cur)->nodes[k];
+        }
+
+        // Number of values that are less than value.
+        [[nodiscard]] std::size_t rank(const T& value) const {
+            if (root == nullptr) {
+                return 0;
+            }
+            key_t key = key_of(value);
+            std::size_t result = 0;
+            block* cur = root;
+            while (!cur->leaf) {
+                inner_block* inner = as_inner(cur);
+                std::size_t i = child_for(inner, key);
+                for (std::size_t j = 0; j < i; j++) {
+                    result += inner->sizes[j];
+                }
+                cur = inner->children[i];
+            }
+            return result + count_less(cur->keys, key);
+        }
+
+        // Position of a node of this index in increasing order.
+        [[nodiscard]] std::size_t rank_of(const base_node<T, Tag>* node) const {
+            return rank(node->get_value());
+        }
+
+        // Builds the index from nodes that are already in increasing order, in O(n)
+        // and without comparisons, with full blocks. The index must be empty.
+        template<class RandomIt>
+        void build_sorted(RandomIt first, RandomIt last, std::size_t = 1) {
+            assert(root == nullptr);
+            auto n = static_cast<std::size_t>(last - first);
+            for (std::size_t i = 0; i < n; i++) {
+                base_node<T, Tag>* cur = *(first + i);
+                cur->prev = i == 0 ? nullptr : *(first + (i - 1));
+                cur->next = i + 1 == n ? nullptr : *(first + (i + 1));
+            }
+            if (n == 0) {
+                return;
+            }
+
+            std::vector<block_ptr> level;
+            level.reserve((n + width - 1) / width);
+            for (std::size_t i = 0; i < n; i += width) {
+                level.emplace_back(new leaf_block());
+                auto* leaf = as_leaf(level.back().get());
+                for (std::size_t j = i; j < std::min(n, i + width); j++) {
+                    base_node<T, Tag>* node = *(first + j);
+                    insert_entry(leaf, leaf->count, key_of(node->get_value()), node);
+                }
+            }
+            while (level.size() > 1) {
+                std::vector<block_ptr> parents;
+                parents.reserve((level.size() + width - 1) / width);
+                for (std::size_t i = 0; i < level.size(); i += width) {
+                    parents.emplace_back(new inner_block());
+                    auto* inner = as_inner(parents.back().get());
+                    for (std::size_t j = i; j < std::min(level.size(), i + width); j++) {
+                        append_child(inner, level[j].release());
+                    }
+                }
+                level = std::move(parents);
+            }
+            root = level.front().release();
+        }
+
+        // Gives this (empty) index the order of `other`, where translate maps each
+        // node of `other` to the node that takes its place here. The blocks are
+        // rebuilt full rather than copied.
+        template<class Translate>
+        void clone_links(const btree_index& other, Translate translate) {
+            std::vector<base_node<T, Tag>*> nodes;
+            for (base_node<T, Tag>* cur = other.get_first_node(); cur != nullptr; cur = cur->next) {
+                nodes.push_back(translate(cur));
+            }
+            build_sorted(nodes.begin(), nodes.end());
+        }
+
+        // Forgets all nodes without touching them and frees the blocks.
+        void detach_all() {
+            if (root != nullptr) {
+                free_blocks(root);
+                root = nullptr;
+            }
+        }
+
+        friend void swap(btree_index& first, btree_index& second) {
+            std::swap(first.root, second.root);
+        }
+
+    private:
+        using key_t = typename btree_key<T, Cmp>::type;
+
+        static constexpr std::size_t width = 16;
+        static constexpr key_t padding = std::numeric_limits<key_t>::max();
+
+        struct inner_block;
+
+        struct block {
+            explicit block(bool leaf)
+                    : leaf(leaf) {
+                std::fill(keys, keys + width, padding);
+            }
+
+            alignas(64) key_t keys[width];
+            inner_block* parent = nullptr;
+            std::size_t count = 0;
+            bool leaf;
+        };
+
+    public:
+        struct leaf_block : block {
+            leaf_block()
+                    : block(true) {
+            }
+
+            base_node<T, Tag>* nodes[width];
+        };
+
+    private:
+        struct inner_block : block {
+            inner_block()
+                    : block(false) {
+            }
+
+            block* children[width];
+            std::size_t sizes[width];
+        };
+
+        static key_t key_of(const T& value) {
+            return btree_key<T, Cmp>::of(value);
+        }
+
+        static leaf_block* as_leaf(block* b) {
+            return static_cast<leaf_block*>(b);
+        }
+
+        static inner_block* as_inner(block* b) {
+            return static_cast<inner_block*>(b);
+        }
+
+        static key_t max_of(const block* b) {
+            return b->keys[b->count - 1];
+        }
+
+        static std::size_t size_of(block* b) {
+            if (b->leaf) {
+                return b->count;
+            }
+            std::size_t result = 0;
+            for (std::size_t i = 0; i < b->count; i++) {
+                result += as_inner(b)->sizes[i];
+            }
+            return result;
+        }
+
+        // The first subtree whose greatest key is not less than key, or the last one.
+        static std::size_t child_for(const inner_block* inner, key_t key) {
+            return std::min(count_less(inner->keys, key), inner->count - 1);
+        }
+
+        std::pair<leaf_block*, std::size_t> locate(key_t key) const {
+            block* cur = root;
+            while (!cur->leaf) {
+                cur = as_inner(cur)->children[child_for(as_inner(cur), key)];
+            }
+            return {as_leaf(cur), count_less(cur->keys, key)};
+        }
+
+        static std::size_t index_in_parent(const block* b) {
+            const inner_block* parent = b->parent;
+            std::size_t i = 0;
+            while (parent->children[i] != b) {
+                ++i;
+            }
+            return i;
+        }
+
+        // Recomputes the greatest keys and the sizes on the path from b to the root.
+        static void refresh(block* b) {
+            for (inner_block* parent = b->parent; parent != nullptr; b = parent, parent = parent->parent) {
+                std::size_t i = index_in_parent(b);
+                parent->keys[i] = max_of(b);
+                parent->sizes[i] = size_of(b);
+            }
+        }
+
+        static void insert_entry(leaf_block* leaf, std::size_t index, key_t key, base_node<T, Tag>* node) {
+            std::copy_backward(leaf->keys + index, leaf->keys + leaf->count, leaf->keys + leaf->count + 1);
+            std::copy_backward(leaf->nodes + index, leaf->nodes + leaf->count, leaf->nodes + leaf->count + 1);
+            leaf->keys[index] = key;
+            leaf->nodes[index] = node;
+            ++leaf->count;
+        }
+
+        static void append_child(inner_block* inner, block* child) {
+            std::size_t i = inner->count++;
+            inner->children[i] = child;
+            inner->keys[i] = max_of(child);
+            inner->sizes[i] = size_of(child);
+            child->parent = inner;
+        }
+
+        // Removes entry index of a block, keeping the unused keys at padding.
+        static void remove_entry(block* b, std::size_t index) {
+            std::copy(b->keys + index + 1, b->keys + b->count, b->keys + index);
+            if (b->leaf) {
+                leaf_block* leaf = as_leaf(b);
+                std::copy(leaf->nodes + index + 1, leaf->nodes + leaf->count, leaf->nodes + index);
+            } else {
+                inner_block* inner = as_inner(b);
+                std::copy(inner->children + index + 1, inner->children + inner->count, inner->children + index);
+                std::copy(inner->sizes + index + 1, inner->sizes + inner->count, inner->sizes + index);
+            }
+            b->keys[--b->count] = padding;
+        }
+
+        // Moves the entries of src to the end of dst, which has room for them.
+        static void append_entries(block* dst, block* src) {
+            assert(dst->leaf == src->leaf && dst->count + src->count <= width);
+            std::copy(src->keys, src->keys + src->count, dst->keys + dst->count);
+            if (dst->leaf) {
+                std::copy(as_leaf(src)->nodes, as_leaf(src)->nodes + src->count, as_leaf(dst)->nodes + dst->count);
+            } else {
+                inner_block* inner = as_inner(dst);
+                for (std::size_t i = 0; i < src->count; i++) {
+                    inner->children[dst->count + i] = as_inner(src)->children[i];
+                    inner->sizes[dst->count + i] = as_inner(src)->sizes[i];
+                    inner->children[dst->count + i]->parent = inner;
+                }
+            }
+            dst->count += src->count;
+            std::fill(src->keys, src->keys + src->count, padding);
+            src->count = 0;
+        }
+
+        // Moves the upper half of a full block into the empty block upper.
+        static std::size_t move_upper_keys(block* b, block* upper) {
+            std::size_t half = width / 2;
+            std::copy(b->keys + half, b->keys + b->count, upper->keys);
+            std::fill(b->keys + half, b->keys + b->count, padding);
+            upper->count = b->count - half;
+            b->count = half;
+            return half;
+        }
+
+        static void move_upper_half(leaf_block* b, leaf_block* upper) {
+            std::size_t half = move_upper_keys(b, upper);
+            std::copy(b->nodes + half, b->nodes + half + upper->count, upper->nodes);
+        }
+
+        static void move_upper_half(inner_block* b, inner_block* upper) {
+            std::size_t half = move_upper_keys(b, upper);
+            for (std::size_t i = 0; i < upper->count; i++) {
+                upper->children[i] = b->children[half + i];
+                upper->sizes[i] = b->sizes[half + i];
+                upper->children[i]->parent = upper;
+            }
+        }
+
+        // Links `right` into the parent of `left`, right after it, splitting full
+        // parents with the preallocated blocks.
+        void insert_child(block* left, block* right) {
+            inner_block* parent = left->parent;
+            if (parent == nullptr) {
+                parent = spare_inners.back().release();
+                spare_inners.pop_back();
+                append_child(parent, left);
+                root = parent;
+            }
+
+            std::size_t index = index_in_parent(left) + 1;
+            if (parent->count == width) {
+                inner_block* upper = spare_inners.back().release();
+                spare_inners.pop_back();
+                move_upper_half(parent, upper);
+                insert_child(parent, upper);
+                if (index > parent->count) {
+                    index -= parent->count;
+                    parent = upper;
+                }
+            }
+
+            std::copy_backward(parent->keys + index, parent->keys + parent->count, parent->keys + parent->count + 1);
+            std::copy_backward(parent->children + index, parent->children + parent->count,
+                               parent->children + parent->count + 1);
+            std::copy_backward(parent->sizes + index, parent->sizes + parent->count, parent->sizes + parent->count + 1);
+            ++parent->count;
+            parent->children[index] = right;
+            parent->keys[index] = max_of(right);
+            parent->sizes[index] = size_of(right);
+            right->parent = parent;
+            std::size_t left_index = index_in_parent(left);
+            parent->keys[left_index] = max_of(left);
+            parent->sizes[left_index] = size_of(left);
+        }
+
+        // Frees an empty block and removes it from its parent; returns the deepest
+        // block whose path to the root needs a refresh.
+        block* remove_block(block* b) {
+            inner_block* parent = b->parent;
+            if (parent == nullptr) {
+                root = nullptr;
+            } else {
+                remove_entry(parent, index_in_parent(b));
+            }
+            if (b->leaf) {
+                delete as_leaf(b);
+            } else {
+                delete as_inner(b);
+            }
+            if (parent == nullptr) {
+                return nullptr;
+            }
+            return (parent->count == 0) ? remove_block(parent) : rebalance(parent);
+        }
+
+        // Merges a block below a quarter of its capacity into a neighbour if they fit
+        // into one block; returns the block that holds its entries now.
+        block* rebalance(block* b) {
+            inner_block* parent = b->parent;
+            if (b->count >= width / 4 || parent == nullptr) {
+                return b;
+            }
+            std::size_t index = index_in_parent(b);
+            if (index > 0 && parent->children[index - 1]->count + b->count <= width) {
+                block* left = parent->children[index - 1];
+                append_entries(left, b);
+                remove_block(b);
+                return left;
+            }
+            if (index + 1 < parent->count && parent->children[index + 1]->count + b->count <= width) {
+                append_entries(b, parent->children[index + 1]);
+                remove_block(parent->children[index + 1]);
+                return b;
+            }
+            return b;
+        }
+
+        // Makes sure a leaf and `inners` inner blocks are at hand for a split.
+        void reserve_blocks(std::size_t inners) {
+            if (spare_leaf == nullptr) {
+                spare_leaf.reset(new leaf_block());
+            }
+            spare_inners.reserve(inners);
+            while (spare_inners.size() < inners) {
+                spare_inners.emplace_back(new inner_block());
+            }
+        }
+
+        // Recurses once per level, so it needs no memory of its own.
+        static void free_blocks(block* b) {
+            if (b->leaf) {
+                delete as_leaf(b);
+                return;
+            }
+            for (std::size_t i = 0; i < b->count; i++) {
+                free_blocks(as_inner(b)->children[i]);
+            }
+            delete as_inner(b);
+        }
+
+        struct subtree_deleter {
+            void operator()(block* b) const {
+                free_blocks(b);
+            }
+        };
+
+        using block_ptr = std::unique_ptr<block, subtree_deleter>;
+
+        block* root = nullptr;
+        std::unique_ptr<leaf_block> spare_leaf;
+        std::vector<std::unique_ptr<inner_block>> spare_inners;
+    };
+}
@@ -0,0 +1,628 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace bmp {
+    // Memory-lean bimap. All pairs live in one contiguous vector and the trees link
+    // them with 32-bit indices, so a pair costs its two values plus 16 bytes of
+    // child links (plus 16 more for the optional prev/next threads). The trees are
+    // scapegoat trees: they need no parent links or per-node balance data and stay
+    // O(log n) deep. Erasing moves the last pair into the freed slot, so iterators
+    // to the last pair in storage are invalidated by an erase, like in a vector.
+    // Without threads, stepping an iterator costs a descent.
+    template<typename Left,
+            typename Right,
+            typename CompareLeft = std::less<Left>,
+            typename CompareRight = std::less<Right>,
+            bool Threaded = true>
+    class compact_bimap {
+    public:
+        using left_t = Left;
+        using right_t = Right;
+        using index_t = std::uint32_t;
+
+        static constexpr index_t nil = std::numeric_limits<index_t>::max();
+
+    private:
+        static constexpr int left_side = 0;
+        static constexpr int right_side = 1;
+
+        struct thread_links {
+            index_t prev[2] = {nil, nil};
+            index_t next[2] = {nil, nil};
+        };
+
+        struct no_thread_links {
+        };
+
+        struct node : std::conditional_t<Threaded, thread_links, no_thread_links> {
+            template<class L, class R>
+            node(L&& left_value, R&& right_value)
+                    : left_value(std::forward<L>(left_value))
+                    , right_value(std::forward<R>(right_value)) {
+            }
+
+            Left left_value;
+            Right right_value;
+            // child[side][0] is the left child and child[side][1] the right one
+            index_t child[2][2] = {{nil, nil}, {nil, nil}};
+        };
+
+    public:
+        static constexpr std::size_t node_size = sizeof(node);
+
+        template<int Side>
+        class basic_iterator {
+        public:
+            using value_type = std::conditional_t<Side == left_side, left_t, right_t>;
+
+            basic_iterator(const compact_bimap* map_ptr, index_t index)
+                    : map_ptr(map_ptr)
+                    , index(index) {
+            }
+
+            const value_type& operator*() const {
+                return map_ptr->template key<Side>(index);
+            }
+
+            const value_type* operator->() const {
+                return &**this;
+            }
+
+            basic_iterator& operator++() {
+                index = map_ptr->template successor<Side>(index);
+                return *this;
+            }
+
+            basic_iterator operator++(int) {
+                auto result = *this;
+                ++(*this);
+                return result;
+            }
+
+            basic_iterator& operator--() {
+                index = (index == nil) ? map_ptr->template extreme<Side>(1) : map_ptr->template predecessor<Side>(index);
+                return *this;
+            }
+
+            basic_iterator operator--(int) {
+                auto result = *this;
+                --(*this);
+                return result;
+            }
+
+            friend bool operator==(const basic_iterator& a, const basic_iterator& b) noexcept {
+                return a.index == b.index;
+            }
+
+            friend bool operator!=(const basic_iterator& a, const basic_iterator& b) noexcept {
+                return !(a == b);
+            }
+
+            basic_iterator<1 - Side> flip() const {
+                return {map_ptr, index};
+            }
+
+            [[nodiscard]] index_t get_index() const {
+                return index;
+            }
+
+        private:
+            const compact_bimap* map_ptr;
+            index_t index;
+        };
+
+        using left_iterator = basic_iterator<left_side>;
+        using right_iterator = basic_iterator<right_side>;
+
+        explicit compact_bimap(CompareLeft compare_left = CompareLeft(), CompareRight compare_right = CompareRight())
+                : left_cmp(compare_left)
+                , right_cmp(compare_right) {
+        }
+
+        void reserve(std::size_t count) {
+            nodes.reserve(count);
+        }
+
+        template<class L = left_t, class R = right_t>
+        left_iterator insert(L&& left, R&& right) {
+            if (nodes.size() == nil) {
+                throw std::length_error("Compact bimap can not hold more than 2^32 - 1 pairs");
+            }
+            reserve_scratch(nodes.size() + 1);
+            position left_pos = find_position<left_side>(left);
+            if (left_pos.found) {
+                return end_left();
+            }
+            position right_pos = find_position<right_side>(right);
+            if (right_pos.found) {
+                return end_left();
+            }
+
+            auto index = static_cast<index_t>(nodes.size());
+            nodes.emplace_back(std::forward<L>(left), std::forward<R>(right));
+            link<left_side>(index, left_pos);
+            link<right_side>(index, right_pos);
+
+            return {this, index};
+        }
+
+        left_iterator erase_left(left_iterator it) {
+            index_t next_index = successor<left_side>(it.get_index());
+            return {this, erase_node(it.get_index(), next_index)};
+        }
+
+        right_iterator erase_right(right_iterator it) {
+            index_t next_index = successor<right_side>(it.get_index());
+            return {this, erase_node(it.get_index(), next_index)};
+        }
+
+        bool erase_left(const left_t& left) {
+            index_t index = find<left_side>(left);
+            if (index == nil) {
+                return false;
+            }
+            erase_node(index, nil);
+            return true;
+        }
+
+        bool erase_right(const right_t& right) {
+            index_t index = find<right_side>(right);
+            if (index == nil) {
+                return false;
+            }
+            erase_node(index, nil);
+            return true;
+        }
+
+        left_iterator find_left(const left_t& left) const {
+            return {this, find<left_side>(left)};
+        }
+
+        right_iterator find_right(const right_t& right) const {
+            return {this, find<right_side>(right)};
+        }
+
+        const right_t& at_left(const left_t& key) const {
+            index_t index = find<left_side>(key);
+            if (index == nil) {
+                throw std::out_of_range("Bimap does not contains left key");
+            }
+            return nodes[index].right_value;
+        }
+
+        const left_t& at_right(const right_t& key) const {
+            index_t index = find<right_side>(key);
+            if (index == nil) {
+                throw std::out_of_range("Bimap does not contains right key");
+            }
+            return nodes[index].left_value;
+        }
+
+        left_iterator lower_bound_left(const left_t& left) const {
+            return {this, bound<left_side>(left, false)};
+        }
+
+        left_iterator upper_bound_left(const left_t& left) const {
+            return {this, bound<left_side>(left, true)};
+        }
+
+        right_iterator lower_bound_right(const right_t& right) const {
+            return {this, bound<right_side>(right, false)};
+        }
+
+        right_iterator upper_bound_right(const right_t& right) const {
+            return {this, bound<right_side>(right, true)};
+        }
+
+        left_iterator begin_left() const {
+            return {this, extreme<left_side>(0)};
+        }
+
+        left_iterator end_left() const {
+            return {this, nil};
+        }
+
+        right_iterator begin_right() const {
+            return {this, extreme<right_side>(0)};
+        }
+
+        right_iterator end_right() const {
+            return {this, nil};
+        }
+
+        [[nodiscard]] std::size_t size() const {
+            return nodes.size();
+        }
+
+        [[nodiscard]] bool empty() const {
+            return nodes.empty();
+        }
+
+        void clear() {
+            nodes.clear();
+            root[left_side] = root[right_side] = nil;
+            max_size[left_side] = max_size[right_side] = 0;
+        }
+
+        friend bool operator==(const compact_bimap& a, const compact_bimap& b) {
+            if (a.size() != b.size()) {
+                return false;
+            }
+
+            for (auto it = a.begin_left(), other = b.begin_left(); it != a.end_left(); ++it, ++other) {
+                if (a.left_cmp(*it, *other) || a.left_cmp(*other, *it) ||
+                    a.right_cmp(*it.flip(), *other.flip()) || a.right_cmp(*other.flip(), *it.flip())) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        friend bool operator!=(const compact_bimap& a, const compact_bimap& b) {
+            return !(a == b);
+        }
+
+    private:
+        // Largest fraction of its parent's size a subtree may have, see rebalance.
+        static constexpr double alpha = 0.7;
+
+        template<int Side>
+        const auto& key(index_t index) const {
+            if constexpr (Side == left_side) {
+                return nodes[index].left_value;
+            } else {
+                return nodes[index].right_value;
+            }
+        }
+
+        template<int Side, class A, class B>
+        bool less(const A& a, const B& b) const {
+            if constexpr (Side == left_side) {
+                return left_cmp(a, b);
+            } else {
+                return right_cmp(a, b);
+            }
+        }
+
+        template<int Side>
+        index_t& child(index_t index, int direction) {
+            return nodes[index].child[Side][direction];
+        }
+
+        template<int Side>
+        index_t child(index_t index, int direction) const {
+            return nodes[index].child[Side][direction];
+        }
+
+        template<int Side, class K>
+        index_t find(const K& value) const {
+            index_t cur = root[Side];
+            while (cur != nil) {
+                if (less<Side>(key<Side>(cur), value)) {
+                    cur = child<Side>(cur, 1);
+                } else if (less<Side>(value, key<Side>(cur))) {
+                    cur = child<Side>(cur, 0);
+                } else {
+                    return cur;
+                }
+            }
+            return nil;
+        }
+
+        // First index whose key is not less than (or, for strict, greater than) value.
+        template<int Side, class K>
+        index_t bound(const K& value, bool strict) const {
+            index_t result = nil;
+            index_t cur = root[Side];
+            while (cur != nil) {
+                bool go_left = strict ? less<Side>(value, key<Side>(cur)) : !less<Side>(key<Side>(cur), value);
+                if (go_left) {
+                    result = cur;
+                    cur = child<Side>(cur, 0);
+                } else {
+                    cur = child<Side>(cur, 1);
+                }
+            }
+            return result;
+        }
+
+        // Smallest (direction 0) or largest (direction 1) index of a side.
+        template<int Side>
+        index_t extreme(int direction) const {
+            index_t cur = root[Side];
+            while (cur != nil && child<Side>(cur, direction) != nil) {
+                cur = child<Side>(cur, direction);
+            }
+            return cur;
+        }
+
+        template<int Side>
+        index_t successor(index_t index) const {
+            if constexpr (Threaded) {
+                return nodes[index].next[Side];
+            } else {
+                return bound<Side>(key<Side>(index), true);
+            }
+        }
+
+        template<int Side>
+        index_t predecessor(index_t index) const {
+            if constexpr (Threaded) {
+                return nodes[index].prev[Side];
+            } else {
+                index_t result = nil;
+                index_t cur = root[Side];
+                while (cur != nil) {
+                    if (less<Side>(key<Side>(cur), key<Side>(index))) {
+                        result = cur;
+                        cur = child<Side>(cur, 1);
+                    } else {
+                        cur = child<Side>(cur, 0);
+                    }
+                }
+                return result;
+            }
+        }
+
+        // Makes room in the scratch space for linking the count-th pair, so that a
+        // stored pair is never linked into one side only: paths and a stack of the
+        // deepest a scapegoat tree of max_size pairs gets (rebuilds keep the depth at
+        // most height_bound(max_size) + 1), and every pair for a rebuild.
+        void reserve_scratch(std::size_t count) {
+            std::size_t depth = height_bound(std::max({count, max_size[left_side], max_size[right_side]})) + 2;
+            path[left_side].reserve(depth);
+            path[right_side].reserve(depth);
+            stack.reserve(depth + 1);
+            order.reserve(count);
+        }
+
+        // Where a value belongs in a side: the neighbours it falls between and, if
+        // it is absent, the direction below the last node of path[Side], which holds
+        // the nodes from the root down.
+        struct position {
+            index_t prev = nil;
+            index_t next = nil;
+            int direction = 0;
+            bool found = false;
+        };
+
+        // One descent that checks for the value and records where it would be linked.
+        template<int Side, class K>
+        position find_position(const K& value) {
+            position result;
+            path[Side].clear();
+            index_t cur = root[Side];
+            while (cur != nil) {
+                if (less<Side>(key<Side>(cur), value)) {
+                    result.direction = 1;
+                    result.prev = cur;
+                } else if (less<Side>(value, key<Side>(cur))) {
+                    result.direction = 0;
+                    result.next = cur;
+                } else {
+                    result.found = true;
+                    return result;
+                }
+                path[Side].push_back(cur);
+                cur = child<Side>(cur, result.direction);
+            }
+            return result;
+        }
+
+        // Links a node at the position find_position returned for its key, then
+        // rebuilds the subtree of the scapegoat if the node ended up deeper than the
+        // alpha height bound.
+        template<int Side>
+        void link(index_t index, const position& pos) {
+            if (path[Side].empty()) {
+                root[Side] = index;
+            } else {
+                child<Side>(path[Side].back(), pos.direction) = index;
+            }
+
+            if constexpr (Threaded) {
+                nodes[index].prev[Side] = pos.prev;
+                nodes[index].next[Side] = pos.next;
+                if (pos.prev != nil) {
+                    nodes[pos.prev].next[Side] = index;
+                }
+                if (pos.next != nil) {
+                    nodes[pos.next].prev[Side] = index;
+                }
+            }
+
+            max_size[Side] = std::max(max_size[Side], nodes.size());
+            if (path[Side].size() > height_bound(nodes.size())) {
+                rebalance<Side>(index);
+            }
+        }
+
+        template<int Side>
+        void rebalance(index_t inserted) {
+            std::size_t subtree = 1;
+            index_t below = inserted;
+            for (std::size_t i = path[Side].size(); i-- > 0;) {
+                index_t cur = path[Side][i];
+                int direction = (child<Side>(cur, 0) == below) ? 0 : 1;
+                std::size_t total = subtree + 1 + count<Side>(child<Side>(cur, 1 - direction));
+                if (subtree > alpha * total) {
+                    index_t rebuilt = rebuild<Side>(cur);
+                    if (i == 0) {
+                        root[Side] = rebuilt;
+                    } else {
+                        int parent_direction = (child<Side>(path[Side][i - 1], 0) == cur) ? 0 : 1;
+                        child<Side>(path[Side][i - 1], parent_direction) = rebuilt;
+                    }
+                    return;
+                }
+                subtree = total;
+                below = cur;
+            }
+        }
+
+        template<int Side>
+        std::size_t count(index_t subtree_root) {
+            std::size_t result = 0;
+            stack.clear();
+            if (subtree_root != nil) {
+                stack.push_back(subtree_root);
+            }
+            while (!stack.empty()) {
+                index_t cur = stack.back();
+                stack.pop_back();
+                ++result;
+                for (int direction = 0; direction < 2; direction++) {
+                    if (child<Side>(cur, direction) != nil) {
+                        stack.push_back(child<Side>(cur, direction));
+                    }
+                }
+            }
+            return result;
+        }
+
+        // Rebuilds a subtree perfectly balanced; the in-order sequence, and so the
+        // threads, stay the same.
+        template<int Side>
+        index_t rebuild(index_t subtree_root) {
+            order.clear();
+            stack.clear();
+            index_t cur = subtree_root;
+            while (cur != nil || !stack.empty()) {
+                while (cur != nil) {
+                    stack.push_back(cur);
+                    cur = child<Side>(cur, 0);
+                }
+                cur = stack.back();
+                stack.pop_back();
+                order.push_back(cur);
+                cur = child<Side>(cur, 1);
+            }
+            return build<Side>(0, order.size());
+        }
+
+        template<int Side>
+        index_t build(std::size_t first, std::size_t last) {
+            if (first == last) {
+                return nil;
+            }
+            std::size_t middle = first + (last - first) / 2;
+            index_t cur = order[middle];
+            child<Side>(cur, 0) = build<Side>(first, middle);
+            child<Side>(cur, 1) = build<Side>(middle + 1, last);
+            return cur;
+        }
+
+        [[nodiscard]] static std::size_t height_bound(std::size_t count) {
+            return static_cast<std::size_t>(std::log(static_cast<double>(count)) / std::log(1 / alpha));
+        }
+
+        // Finds the link that points to the node with the key of `index`.
+        template<int Side>
+        index_t& link_to(index_t index) {
+            index_t* link = &root[Side];
+            while (*link != index) {
+                int direction = less<Side>(key<Side>(*link), key<Side>(index)) ? 1 : 0;
+                link = &child<Side>(*link, direction);
+            }
+            return *link;
+        }
+
+        template<int Side>
+        void unlink(index_t index) {
+            index_t& link = link_to<Side>(index);
+            index_t left_child = child<Side>(index, 0);
+            index_t right_child = child<Side>(index, 1);
+
+            if (left_child == nil || right_child == nil) {
+                link = (left_child != nil) ? left_child : right_child;
+            } else {
+                index_t* successor_link = &child<Side>(index, 1);
+                while (child<Side>(*successor_link, 0) != nil) {
+                    successor_link = &child<Side>(*successor_link, 0);
+                }
+                index_t successor_index = *successor_link;
+                *successor_link = child<Side>(successor_index, 1);
+                child<Side>(successor_index, 0) = left_child;
+                child<Side>(successor_index, 1) = child<Side>(index, 1);
+                link = successor_index;
+            }
+
+            if constexpr (Threaded) {
+                index_t prev = nodes[index].prev[Side];
+                index_t next = nodes[index].next[Side];
+                if (prev != nil) {
+                    nodes[prev].next[Side] = next;
+                }
+                if (next != nil) {
+                    nodes[next].prev[Side] = prev;
+                }
+            }
+
+            if (nodes.size() - 1 < alpha * max_size[Side]) {
+                root[Side] = rebuild_all<Side>();
+                max_size[Side] = nodes.size() - 1;
+            }
+        }
+
+        template<int Side>
+        index_t rebuild_all() {
+            return (root[Side] == nil) ? nil : rebuild<Side>(root[Side]);
+        }
+
+        // Points every link to the node at `from` (about to move) to `to` instead.
+        template<int Side>
+        void relocate(index_t from, index_t to) {
+            link_to<Side>(from) = to;
+            if constexpr (Threaded) {
+                index_t prev = nodes[from].prev[Side];
+                index_t next = nodes[from].next[Side];
+                if (prev != nil) {
+                    nodes[prev].next[Side] = to;
+                }
+                if (next != nil) {
+                    nodes[next].prev[Side] = to;
+                }
+            }
+        }
+
+        // Removes a pair and returns where `tracked` lives afterwards.
+        index_t erase_node(index_t index, index_t tracked) {
+            unlink<left_side>(index);
+            unlink<right_side>(index);
+
+            auto last = static_cast<index_t>(nodes.size() - 1);
+            if (index != last) {
+                relocate<left_side>(last, index);
+                relocate<right_side>(last, index);
+                nodes[index] = std::move(nodes[last]);
+                if (tracked == last) {
+                    tracked = index;
+                }
+            }
+            nodes.pop_back();
+            return tracked;
+        }
+
+        std::vector<node> nodes;
+        index_t root[2] = {nil, nil};
+        std::size_t max_size[2] = {0, 0};
+
+        // scratch space of inserts and rebuilds, kept to avoid allocations; path[Side]
+        // holds the last descent into a side
+        std::vector<index_t> path[2];
+        std::vector<index_t> stack;
+        std::vector<index_t> order;
+
+        CompareLeft left_cmp;
+        CompareRight right_cmp;
+    };
+}
@@ -0,0 +1,291 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <type_traits>
+
+#include "bimap.h"
+
+namespace bmp {
+    // Thread-safe bimap sharded by hash. Every pair is stored once, in a node of
+    // its own, and indexed twice: by its left value in the left shard picked by the
+    // hash of that value, and by its right value in the right shard picked by the
+    // hash of that one. A shard holds the index of one side under its own
+    // reader-writer lock, so memory is that of one bimap plus the shards. Lookups
+    // lock one shard for reading, or for writing if its index restructures on
+    // lookups. Writers lock the left shard of a pair before its right shard, so
+    // both uniqueness checks of an insert and both halves of an erase are atomic.
+    // Lookups return copies of the values.
+    template<typename Left,
+            typename Right,
+            typename CompareLeft = std::less<Left>,
+            typename CompareRight = std::less<Right>,
+            typename HashLeft = std::hash<Left>,
+            typename HashRight = std::hash<Right>>
+    class concurrent_bimap {
+    public:
+        using left_t = Left;
+        using right_t = Right;
+
+        // The comparators (or hashed<> functions) are given to the index of every
+        // shard; the hashers pick the shards.
+        explicit concurrent_bimap(std::size_t shard_count = 64,
+                                  CompareLeft compare_left = CompareLeft(),
+                                  CompareRight compare_right = CompareRight(),
+                                  HashLeft hash_left = HashLeft(),
+                                  HashRight hash_right = HashRight())
+                : shard_count(round_up(shard_count))
+                , left_shards(std::make_unique<shard<left_index_t>[]>(this->shard_count))
+                , right_shards(std::make_unique<shard<right_index_t>[]>(this->shard_count))
+                , hash_left(std::move(hash_left))
+                , hash_right(std::move(hash_right)) {
+            for (std::size_t i = 0; i < this->shard_count; i++) {
+                left_shards[i].index.set_comparator(compare_left);
+                right_shards[i].index.set_comparator(compare_right);
+            }
+        }
+
+        concurrent_bimap(const concurrent_bimap&) = delete;
+        concurrent_bimap& operator=(const concurrent_bimap&) = delete;
+
+        ~concurrent_bimap() {
+            delete_nodes();
+        }
+
+        // Inserts the pair if neither of its values is in the bimap.
+        bool insert(const left_t& left, const right_t& right) {
+            shard<left_index_t>& left_shard = left_shard_of(left);
+            shard<right_index_t>& right_shard = right_shard_of(right);
+            std::unique_lock left_lock(left_shard.mutex);
+            std::unique_lock right_lock(right_shard.mutex);
+            reserve_for_insert(left_shard.index);
+            reserve_for_insert(right_shard.index);
+            auto left_pos = left_shard.index.find_position(left);
+            if (left_pos.found) {
+                return false;
+            }
+            auto right_pos = right_shard.index.find_position(right);
+            if (right_pos.found) {
+                return false;
+            }
+
+            auto new_node = std::make_unique<node_t>(left, right);
+            left_shard.index.insert_at(left_pos, new_node.get());
+            try {
+                right_shard.index.insert_at(right_pos, new_node.get());
+            } catch (...) {
+                left_shard.index.erase_node(new_node.get());
+                throw;
+            }
+            new_node.release();
+            count.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        bool erase_left(const left_t& left) {
+            shard<left_index_t>& left_shard = left_shard_of(left);
+            std::unique_lock left_lock(left_shard.mutex);
+            auto* found = static_cast<node_t*>(left_shard.index.find(left));
+            if (found == nullptr) {
+                return false;
+            }
+
+            shard<right_index_t>& right_shard = right_shard_of(right_value(found));
+            std::unique_lock right_lock(right_shard.mutex);
+            unlink(left_shard, right_shard, found);
+            return true;
+        }
+
+        bool erase_right(const right_t& right) {
+            shard<right_index_t>& right_shard = right_shard_of(right);
+            while (true) {
+                std::optional<left_t> left = find_right(right);
+                if (!left) {
+                    return false;
+                }
+
+                // the right shard can only be locked after the left one, so the pair
+                // may have changed in between; then the left shard is looked up again
+                shard<left_index_t>& left_shard = left_shard_of(*left);
+                std::unique_lock left_lock(left_shard.mutex);
+                std::unique_lock right_lock(right_shard.mutex);
+                auto* found = static_cast<node_t*>(right_shard.index.find(right));
+                if (found == nullptr) {
+                    return false;
+                }
+                if (&left_shard_of(left_value(found)) != &left_shard) {
+                    continue;
+                }
+
+                unlink(left_shard, right_shard, found);
+                return true;
+            }
+        }
+
+        // The partner of a value is read under the lock of the value's shard: a node
+        // is only freed by writers that hold the locks of both of its shards.
+        std::optional<right_t> find_left(const left_t& left) const {
+            const shard<left_index_t>& left_shard = left_shard_of(left);
+            read_lock_t<left_index_t> lock(left_shard.mutex);
+            auto* found = static_cast<const node_t*>(left_shard.index.find(left));
+            if (found == nullptr) {
+                return std::nullopt;
+            }
+            return right_value(found);
+        }
+
+        std::optional<left_t> find_right(const right_t& right) const {
+            const shard<right_index_t>& right_shard = right_shard_of(right);
+            read_lock_t<right_index_t> lock(right_shard.mutex);
+            auto* found = static_cast<const node_t*>(right_shard.index.find(right));
+            if (found == nullptr) {
+                return std::nullopt;
+            }
+            return left_value(found);
+        }
+
+        right_t at_left(const left_t& left) const {
+            std::optional<right_t> right = find_left(left);
+            if (!right) {
+                throw std::out_of_range("Bimap does not contains left key");
+            }
+            return std::move(*right);
+        }
+
+        left_t at_right(const right_t& right) const {
+            std::optional<left_t> left = find_right(right);
+            if (!left) {
+                throw std::out_of_range("Bimap does not contains right key");
+            }
+            return std::move(*left);
+        }
+
+        // Exact when no writer runs concurrently.
+        [[nodiscard]] std::size_t size() const {
+            return count.load(std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] bool empty() const {
+            return size() == 0;
+        }
+
+        void clear() {
+            std::unique_ptr<std::unique_lock<std::shared_mutex>[]> locks =
+                    std::make_unique<std::unique_lock<std::shared_mutex>[]>(2 * shard_count);
+            for (std::size_t i = 0; i < shard_count; i++) {
+                locks[i] = std::unique_lock(left_shards[i].mutex);
+            }
+            for (std::size_t i = 0; i < shard_count; i++) {
+                locks[shard_count + i] = std::unique_lock(right_shards[i].mutex);
+            }
+            delete_nodes();
+            count.store(0, std::memory_order_relaxed);
+        }
+
+        // Calls f(left, right) for every pair, one left shard at a time; every shard
+        // is seen in a consistent state, but not all of them at the same moment.
+        template<class F>
+        void for_each(F f) const {
+            for (std::size_t i = 0; i < shard_count; i++) {
+                read_lock_t<left_index_t> lock(left_shards[i].mutex);
+                for (auto* cur = left_shards[i].index.get_first_node(); cur != nullptr; cur = cur->next) {
+                    f(left_value(static_cast<const node_t*>(cur)), right_value(static_cast<const node_t*>(cur)));
+                }
+            }
+        }
+
+        [[nodiscard]] std::size_t get_shard_count() const {
+            return shard_count;
+        }
+
+    private:
+        using node_t = double_node<Left, Right>;
+        using left_index_t = index_for_t<Left, left_tag, CompareLeft>;
+        using right_index_t = index_for_t<Right, right_tag, CompareRight>;
+
+        // one cache line per shard, so that locking one does not slow its neighbours
+        template<class Index>
+        struct alignas(64) shard {
+            mutable std::shared_mutex mutex;
+            Index index;
+        };
+
+        template<class Index>
+        using read_lock_t = std::conditional_t<Index::restructures_on_access,
+                                               std::unique_lock<std::shared_mutex>,
+                                               std::shared_lock<std::shared_mutex>>;
+
+        static std::size_t round_up(std::size_t n) {
+            std::size_t result = 1;
+            while (result < n) {
+                result *= 2;
+            }
+            return result;
+        }
+
+        static const left_t& left_value(const node_t* node) {
+            return static_cast<const base_node<Left, left_tag>*>(node)->get_value();
+        }
+
+        static const right_t& right_value(const node_t* node) {
+            return static_cast<const base_node<Right, right_tag>*>(node)->get_value();
+        }
+
+        // A hashed index may rehash and a B-tree may split on insert_at; both get
+        // their memory before the positions are looked up instead, so that a node
+        // is never linked into one side only.
+        template<class Index>
+        static void reserve_for_insert(Index& index) {
+            index.reserve(index.size() + 1);
+        }
+
+        void unlink(shard<left_index_t>& left_shard, shard<right_index_t>& right_shard, node_t* node) {
+            right_shard.index.erase_node(node);
+            left_shard.index.erase_node(node);
+            delete node;
+            count.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        // Every node is in exactly one left shard; the caller holds all locks or is
+        // the destructor.
+        void delete_nodes() {
+            for (std::size_t i = 0; i < shard_count; i++) {
+                auto* cur = left_shards[i].index.get_first_node();
+                left_shards[i].index.detach_all();
+                right_shards[i].index.detach_all();
+                while (cur != nullptr) {
+                    auto* next = cur->next;
+                    delete static_cast<node_t*>(cur);
+                    cur = next;
+                }
+            }
+        }
+
+        std::size_t shard_index(std::size_t hash) const {
+            auto bits = static_cast<std::uint64_t>(hash) * 0x9E3779B97F4A7C15ull;
+            return static_cast<std::size_t>(bits ^ (bits >> 32)) & (shard_count - 1);
+        }
+
+        shard<left_index_t>& left_shard_of(const left_t& left) const {
+            return left_shards[shard_index(hash_left(left))];
+        }
+
+        shard<right_index_t>& right_shard_of(const right_t& right) const {
+            return right_shards[shard_index(hash_right(right))];
+        }
+
+        std::size_t shard_count;
+        std::unique_ptr<shard<left_index_t>[]> left_shards;
+        std::unique_ptr<shard<right_index_t>[]> right_shards;
+        HashLeft hash_left;
+        HashRight hash_right;
+        std::atomic<std::size_t> count{0};
+    };
+}
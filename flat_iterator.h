@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace bmp {
+    // Iterator of a read-only bimap that keeps both sides as arrays: a position in
+    // the array of one side, and flip() moves to the position of the partner in the
+    // other one. Map provides value<IsLeft>(i), partner<IsLeft>(i) and the positions
+    // next<IsLeft>(i) and prev<IsLeft>(i) in the order of the side, and befriends
+    // the iterator.
+    template<class Map, bool IsLeft>
+    class flat_iterator {
+    public:
+        using value_type = std::conditional_t<IsLeft, typename Map::left_t, typename Map::right_t>;
+
+        const value_type& operator*() const {
+            return map->template value<IsLeft>(index);
+        }
+
+        const value_type* operator->() const {
+            return &map->template value<IsLeft>(index);
+        }
+
+        flat_iterator& operator++() {
+            index = map->template next<IsLeft>(index);
+            return *this;
+        }
+
+        flat_iterator operator++(int) {
+            flat_iterator result = *this;
+            ++*this;
+            return result;
+        }
+
+        flat_iterator& operator--() {
+            index = map->template prev<IsLeft>(index);
+            return *this;
+        }
+
+        flat_iterator operator--(int) {
+            flat_iterator result = *this;
+            --*this;
+            return result;
+        }
+
+        flat_iterator<Map, !IsLeft> flip() const {
+            return flat_iterator<Map, !IsLeft>(map, static_cast<std::size_t>(map->template partner<IsLeft>(index)));
+        }
+
+        // Position in the array of the side.
+        [[nodiscard]] std::size_t get_index() const {
+            return index;
+        }
+
+        friend bool operator==(const flat_iterator& a, const flat_iterator& b) {
+            return a.index == b.index;
+        }
+
+        friend bool operator!=(const flat_iterator& a, const flat_iterator& b) {
+            return a.index != b.index;
+        }
+
+    private:
+        friend Map;
+        friend class flat_iterator<Map, !IsLeft>;
+
+        flat_iterator(const Map* map, std::size_t index)
+                : map(map)
+                , index(index) {
+        }
+
+        const Map* map;
+        std::size_t index;
+    };
+
+    // Positions of the partners of a bimap with two ordered sides: for each pair in
+    // left order the position of its right value in right order, and vice versa.
+    // Both orders are sorted by the address of the pair and then line up, which
+    // takes O(n log n) without comparisons of values.
+    template<class Index, class Bimap>
+    void partner_positions(const Bimap& map, std::vector<Index>& right_of_left, std::vector<Index>& left_of_right) {
+        std::vector<std::pair<const void*, Index>> left_positions;
+        std::vector<std::pair<const void*, Index>> right_positions;
+        left_positions.reserve(map.size());
+        right_positions.reserve(map.size());
+        for (auto it = map.begin_left(); it != map.end_left(); ++it) {
+            left_positions.emplace_back(&*it, static_cast<Index>(left_positions.size()));
+        }
+        for (auto it = map.begin_right(); it != map.end_right(); ++it) {
+            right_positions.emplace_back(&*it, static_cast<Index>(right_positions.size()));
+        }
+        // both values of a pair are in the same node, at the same distance
+        auto by_address = [](const auto& a, const auto& b) {
+            return std::less<const void*>()(a.first, b.first);
+        };
+        std::sort(left_positions.begin(), left_positions.end(), by_address);
+        std::sort(right_positions.begin(), right_positions.end(), by_address);
+
+        right_of_left.assign(map.size(), 0);
+        left_of_right.assign(map.size(), 0);
+        for (std::size_t i = 0; i < left_positions.size(); i++) {
+            right_of_left[left_positions[i].second] = right_positions[i].second;
+            left_of_right[right_positions[i].second] = left_positions[i].second;
+        }
+    }
+}
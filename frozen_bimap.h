@@ -0,0 +1,334 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "bimap.h"
+#include "flat_iterator.h"
+#include "prefetch.h"
+
+namespace bmp {
+    // Read-only bimap compiled from a bimap with two ordered sides, see
+    // bimap::freeze(). Every side keeps its values once, in Eytzinger layout (the
+    // levels of a complete binary search tree, one after the other): a search reads
+    // a predictable sequence of slots, chooses the next one with a comparison
+    // instead of a branch and prefetches four levels ahead. Iterators hold slots and
+    // step to the in-order neighbour with index arithmetic; the slot of every rank
+    // serves nth and begin. flip() reads the slot of the partner from an array
+    // instead of converting nodes.
+    template<typename Left,
+            typename Right,
+            typename CompareLeft = std::less<Left>,
+            typename CompareRight = std::less<Right>>
+    class frozen_bimap {
+    public:
+        using left_t = Left;
+        using right_t = Right;
+        using left_iterator = flat_iterator<frozen_bimap, true>;
+        using right_iterator = flat_iterator<frozen_bimap, false>;
+
+        explicit frozen_bimap(CompareLeft compare_left = CompareLeft(), CompareRight compare_right = CompareRight())
+                : left(std::move(compare_left))
+                , right(std::move(compare_right)) {
+        }
+
+        template<typename Allocator>
+        explicit frozen_bimap(const bimap<Left, Right, CompareLeft, CompareRight, Allocator>& map,
+                              CompareLeft compare_left = CompareLeft(),
+                              CompareRight compare_right = CompareRight())
+                : frozen_bimap(std::move(compare_left), std::move(compare_right)) {
+            using map_t = bimap<Left, Right, CompareLeft, CompareRight, Allocator>;
+            static_assert(map_t::left_tree_t::is_ordered && map_t::right_tree_t::is_ordered,
+                          "frozen_bimap needs two ordered sides");
+            if (map.size() >= std::numeric_limits<index_t>::max()) {
+                throw std::length_error("Frozen bimap can not hold more than 2^32 - 2 pairs");
+            }
+
+            std::vector<left_t> lefts;
+            lefts.reserve(map.size());
+            for (auto it = map.begin_left(); it != map.end_left(); ++it) {
+                lefts.push_back(*it);
+            }
+            left.build_layout(std::move(lefts));
+            std::vector<right_t> rights;
+            rights.reserve(map.size());
+            for (auto it = map.begin_right(); it != map.end_right(); ++it) {
+                rights.push_back(*it);
+            }
+            right.build_layout(std::move(rights));
+
+            // partner_positions gives ranks, the iterators need slots
+            std::vector<index_t> right_of_left;
+            std::vector<index_t> left_of_right;
+            partner_positions(map, right_of_left, left_of_right);
+            left.partners.assign(map.size() + 1, 0);
+            right.partners.assign(map.size() + 1, 0);
+            for (std::size_t rank = 0; rank < map.size(); rank++) {
+                left.partners[left.slot_of_rank[rank]] = right.slot_of_rank[right_of_left[rank]];
+                right.partners[right.slot_of_rank[rank]] = left.slot_of_rank[left_of_right[rank]];
+            }
+        }
+
+        left_iterator find_left(const left_t& key) const {
+            return left_iterator(this, left.find(key));
+        }
+
+        right_iterator find_right(const right_t& key) const {
+            return right_iterator(this, right.find(key));
+        }
+
+        const right_t& at_left(const left_t& key) const {
+            left_iterator it = find_left(key);
+            if (it == end_left()) {
+                throw std::out_of_range("Bimap does not contains left key");
+            }
+            return *it.flip();
+        }
+
+        const left_t& at_right(const right_t& key) const {
+            right_iterator it = find_right(key);
+            if (it == end_right()) {
+                throw std::out_of_range("Bimap does not contains right key");
+            }
+            return *it.flip();
+        }
+
+        left_iterator lower_bound_left(const left_t& key) const {
+            return left_iterator(this, left.lower_bound(key));
+        }
+
+        left_iterator upper_bound_left(const left_t& key) const {
+            return left_iterator(this, left.upper_bound(key));
+        }
+
+        right_iterator lower_bound_right(const right_t& key) const {
+            return right_iterator(this, right.lower_bound(key));
+        }
+
+        right_iterator upper_bound_right(const right_t& key) const {
+            return right_iterator(this, right.upper_bound(key));
+        }
+
+        left_iterator nth_left(std::size_t k) const {
+            return left_iterator(this, left.nth(k));
+        }
+
+        right_iterator nth_right(std::size_t k) const {
+            return right_iterator(this, right.nth(k));
+        }
+
+        // Position of the pair in the order of the side, in O(log^2 n).
+        [[nodiscard]] std::size_t index_of(left_iterator it) const {
+            return left.rank_of(it.get_index());
+        }
+
+        [[nodiscard]] std::size_t index_of(right_iterator it) const {
+            return right.rank_of(it.get_index());
+        }
+
+        left_iterator begin_left() const {
+            return nth_left(0);
+        }
+
+        left_iterator end_left() const {
+            return left_iterator(this, 0);
+        }
+
+        right_iterator begin_right() const {
+            return nth_right(0);
+        }
+
+        right_iterator end_right() const {
+            return right_iterator(this, 0);
+        }
+
+        [[nodiscard]] std::size_t size() const {
+            return left.slot_of_rank.size();
+        }
+
+        [[nodiscard]] bool empty() const {
+            return size() == 0;
+        }
+
+    private:
+        friend left_iterator;
+        friend right_iterator;
+
+        using index_t = std::uint32_t;
+
+        // Slots of the layout are numbered from 1, slot k has the children 2k and
+        // 2k + 1; slot 0 holds no value and is the end position.
+        template<typename T, typename Cmp>
+        struct side {
+            explicit side(Cmp comparator)
+                    : comparator(std::move(comparator)) {
+            }
+
+            // Fills the layout with values in order by an in-order walk of the
+            // implicit tree.
+            void build_layout(std::vector<T> sorted) {
+                std::size_t n = sorted.size();
+                slot_of_rank.assign(n, 0);
+                if (n == 0) {
+                    return;
+                }
+                layout.assign(n + 1, sorted.front());
+                std::size_t next = 0;
+                std::vector<std::size_t> stack;
+                for (std::size_t k = 1; k <= n || !stack.empty();) {
+                    if (k <= n) {
+                        stack.push_back(k);
+                        k = 2 * k;
+                    } else {
+                        k = stack.back();
+                        stack.pop_back();
+                        layout[k] = std::move(sorted[next]);
+                        slot_of_rank[next++] = static_cast<index_t>(k);
+                        k = 2 * k + 1;
+                    }
+                }
+            }
+
+            [[nodiscard]] std::size_t size() const {
+                return slot_of_rank.size();
+            }
+
+            // Slot of the first value that goes_right does not hold for, 0 if there
+            // is none. The descent goes right while it holds; the answer is the last
+            // slot where it went left, which the trailing one bits of k undo.
+            template<class GoesRight>
+            std::size_t descend(GoesRight goes_right) const {
+                std::size_t n = size();
+                std::size_t k = 1;
+                while (k <= n) {
+                    if (16 * k <= n) {
+                        prefetch(&layout[16 * k]);
+                    }
+                    k = 2 * k + static_cast<std::size_t>(goes_right(layout[k]));
+                }
+                while (k & 1) {
+                    k >>= 1;
+                }
+                return k >> 1;
+            }
+
+            std::size_t lower_bound(const T& key) const {
+                return descend([this, &key](const T& value) { return comparator(value, key); });
+            }
+
+            std::size_t upper_bound(const T& key) const {
+                return descend([this, &key](const T& value) { return !comparator(key, value); });
+            }
+
+            std::size_t find(const T& key) const {
+                std::size_t k = lower_bound(key);
+                return (k == 0 || comparator(key, layout[k])) ? 0 : k;
+            }
+
+            std::size_t nth(std::size_t rank) const {
+                return rank < size() ? slot_of_rank[rank] : 0;
+            }
+
+            // In-order successor: the leftmost slot of the right subtree, or the
+            // first ancestor reached from a left child.
+            std::size_t next(std::size_t k) const {
+                std::size_t n = size();
+                if (2 * k + 1 <= n) {
+                    k = 2 * k + 1;
+                    while (2 * k <= n) {
+                        k = 2 * k;
+                    }
+                    return k;
+                }
+                while (k & 1) {
+                    k >>= 1;
+                }
+                return k >> 1;
+            }
+
+            // In-order predecessor, the last slot for the end position.
+            std::size_t prev(std::size_t k) const {
+                if (k == 0) {
+                    return slot_of_rank.back();
+                }
+                std::size_t n = size();
+                if (2 * k <= n) {
+                    k = 2 * k;
+                    while (2 * k + 1 <= n) {
+                        k = 2 * k + 1;
+                    }
+                    return k;
+                }
+                while (k != 0 && (k & 1) == 0) {
+                    k >>= 1;
+                }
+                return k >> 1;
+            }
+
+            // Number of slots in the subtree of slot k.
+            std::size_t subtree_size(std::size_t k) const {
+                std::size_t n = size();
+                std::size_t result = 0;
+                for (std::size_t first = k, last = k; first <= n; first = 2 * first, last = 2 * last + 1) {
+                    result += std::min(last, n) - first + 1;
+                }
+                return result;
+            }
+
+            // Rank of the value in slot k, size() for the end position: the left
+            // subtree of k, and every ancestor left behind by a step up from a right
+            // child with its left subtree.
+            std::size_t rank_of(std::size_t k) const {
+                if (k == 0) {
+                    return size();
+                }
+                std::size_t result = subtree_size(2 * k);
+                for (; k > 1; k >>= 1) {
+                    if (k & 1) {
+                        result += subtree_size(k - 1) + 1;
+                    }
+                }
+                return result;
+            }
+
+            Cmp comparator;
+            std::vector<T> layout;
+            std::vector<index_t> slot_of_rank;
+            // slot of the partner of the value in every slot, in the other side
+            std::vector<index_t> partners;
+        };
+
+        template<bool IsLeft>
+        const auto& value(std::size_t k) const {
+            if constexpr (IsLeft) {
+                return left.layout[k];
+            } else {
+                return right.layout[k];
+            }
+        }
+
+        template<bool IsLeft>
+        index_t partner(std::size_t k) const {
+            return IsLeft ? left.partners[k] : right.partners[k];
+        }
+
+        template<bool IsLeft>
+        std::size_t next(std::size_t k) const {
+            return IsLeft ? left.next(k) : right.next(k);
+        }
+
+        template<bool IsLeft>
+        std::size_t prev(std::size_t k) const {
+            return IsLeft ? left.prev(k) : right.prev(k);
+        }
+
+        side<left_t, CompareLeft> left;
+        side<right_t, CompareRight> right;
+    };
+}
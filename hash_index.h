@@ -0,0 +1,325 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "prefetch.h"
+
+namespace bmp {
+    template<class T, class Tag>
+    class base_node;
+
+    // Comparator slot marker that makes a side of a bimap hashed instead of ordered:
+    // bimap<L, R, hashed<std::hash<L>>>.
+    template<class Hash, class Equal = std::equal_to<>>
+    struct hashed {
+        hashed() = default;
+
+        explicit hashed(Hash hash, Equal equal = Equal())
+                : hash(std::move(hash))
+                , equal(std::move(equal)) {
+        }
+
+        Hash hash;
+        Equal equal;
+    };
+
+    // Hash index over the nodes of one side of a bimap, with the same interface as
+    // tree where it makes sense. The table is a flat array of node pointers with
+    // their hashes, probed linearly and kept free of tombstones by backward shift
+    // deletion. The threads of the nodes link them in insertion order, which is
+    // the iteration order of a hashed side.
+    template<typename T, typename Tag, typename Hash, typename Equal>
+    class hash_index {
+    public:
+        using node_t = base_node<T, Tag>;
+
+        static constexpr bool is_ordered = false;
+        static constexpr bool restructures_on_access = false;
+
+        struct position {
+            base_node<T, Tag>* place = nullptr;
+            bool found = false;
+            std::size_t slot = 0;
+            std::size_t hash = 0;
+        };
+
+        explicit hash_index(hashed<Hash, Equal> functions = hashed<Hash, Equal>())
+                : functions(std::move(functions)) {
+        }
+
+        base_node<T, Tag>* get_first_node() const {
+            return head;
+        }
+
+        base_node<T, Tag>* get_last_node() const {
+            return tail;
+        }
+
+        void set_comparator(hashed<Hash, Equal> new_functions) {
+            functions = std::move(new_functions);
+        }
+
+        // Other key types than T need a transparent Hash and Equal that hash them
+        // like the T they are equal to.
+        template<class K>
+        position find_position(const K& value) const {
+            position result;
+            result.hash = hash_of(value);
+            if (slots.empty()) {
+                return result;
+            }
+
+            std::size_t i = result.hash & mask();
+            while (slots[i].node != nullptr) {
+                if (slots[i].hash == result.hash && functions.equal(slots[i].node->get_value(), value)) {
+                    result.place = slots[i].node;
+                    result.found = true;
+                    break;
+                }
+                i = (i + 1) & mask();
+            }
+            result.slot = i;
+            return result;
+        }
+
+        // Hints only make sense for ordered sides.
+        template<class K>
+        position find_position(base_node<T, Tag>*, const K& value) const {
+            return find_position(value);
+        }
+
+        void insert(base_node<T, Tag>* value_node) {
+            position pos = find_position(value_node->get_value());
+            if (!pos.found) {
+                insert_at(pos, value_node);
+            }
+        }
+
+        // Links value_node at a position returned by find_position for its value.
+        void insert_at(const position& pos, base_node<T, Tag>* value_node) {
+            assert(!pos.found);
+            if ((count + 1) * 4 > slots.size() * 3) {
+                rehash(std::max<std::size_t>(16, slots.size() * 2));
+                place(value_node, pos.hash);
+            } else {
+                slots[pos.slot] = {value_node, pos.hash};
+            }
+            append(value_node);
+            ++count;
+        }
+
+        template<class K>
+        void erase(const K& value) {
+            base_node<T, Tag>* node = find(value);
+            if (node != nullptr) {
+                erase_node(node);
+            }
+        }
+
+        // Unlinks a node of this index; the only call of the hash function, no
+        // equality checks.
+        void erase_node(base_node<T, Tag>* node) {
+            std::size_t i = hash_of(node->get_value()) & mask();
+            while (slots[i].node != node) {
+                i = (i + 1) & mask();
+            }
+
+            for (std::size_t j = (i + 1) & mask(); slots[j].node != nullptr; j = (j + 1) & mask()) {
+                std::size_t home = slots[j].hash & mask();
+                // slot j may move back to i unless its home lies cyclically in (i, j]
+                bool stays = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+                if (!stays) {
+                    slots[i] = slots[j];
+                    i = j;
+                }
+            }
+            slots[i] = {nullptr, 0};
+
+            if (node->prev != nullptr) {
+                node->prev->next = node->next;
+            } else {
+                head = node->next;
+            }
+            if (node->next != nullptr) {
+                node->next->prev = node->prev;
+            } else {
+                tail = node->prev;
+            }
+            node->next = nullptr;
+            node->prev = nullptr;
+            --count;
+        }
+
+        template<class K>
+        base_node<T, Tag>* find(const K& value) const {
+            position pos = find_position(value);
+            return pos.found ? pos.place : nullptr;
+        }
+
+        // Looks up keys[0, count) and stores the found nodes (nullptr if absent) in
+        // out, in groups whose slots, and then nodes, are prefetched together so
+        // that their cache misses overlap.
+        template<class RandomIt>
+        void find_interleaved(RandomIt keys, std::size_t count, base_node<T, Tag>** out) const {
+            static constexpr std::size_t group = 16;
+            std::size_t hashes[group];
+            std::size_t slot_of[group];
+            for (std::size_t first = 0; first < count; first += group) {
+                std::size_t width = std::min(group, count - first);
+                if (slots.empty()) {
+                    std::fill(out + first, out + first + width, nullptr);
+                    continue;
+                }
+                for (std::size_t i = 0; i < width; i++) {
+                    hashes[i] = hash_of(keys[first + i]);
+                    prefetch(&slots[hashes[i] & mask()]);
+                }
+                for (std::size_t i = 0; i < width; i++) {
+                    std::size_t j = hashes[i] & mask();
+                    while (slots[j].node != nullptr && slots[j].hash != hashes[i]) {
+                        j = (j + 1) & mask();
+                    }
+                    slot_of[i] = j;
+                    if (slots[j].node != nullptr) {
+                        prefetch(slots[j].node);
+                    }
+                }
+                for (std::size_t i = 0; i < width; i++) {
+                    std::size_t j = slot_of[i];
+                    while (slots[j].node != nullptr &&
+                           (slots[j].hash != hashes[i] || !functions.equal(slots[j].node->get_value(), keys[first + i]))) {
+                        j = (j + 1) & mask();
+                    }
+                    out[first + i] = slots[j].node;
+                }
+            }
+        }
+
+        [[nodiscard]] bool equivalent(const T& a, const T& b) const {
+            return functions.equal(a, b);
+        }
+
+        [[nodiscard]] std::size_t size() const {
+            return count;
+        }
+
+        // Links nodes with distinct values, keeping their order for iteration.
+        template<class RandomIt>
+        void build_sorted(RandomIt first, RandomIt last) {
+            assert(count == 0);
+            rehash(capacity_for(last - first));
+            for (; first != last; ++first) {
+                base_node<T, Tag>* node = *first;
+                place(node, hash_of(node->get_value()));
+                append(node);
+                ++count;
+            }
+        }
+
+        // Gives this (empty) index the contents of `other`, where translate maps each
+        // node of `other` to the node that takes its place here. Hashes are reused.
+        template<class Translate>
+        void clone_links(const hash_index& other, Translate translate) {
+            assert(count == 0);
+            slots.resize(other.slots.size());
+            for (std::size_t i = 0; i < slots.size(); i++) {
+                slots[i] = {translate(other.slots[i].node), other.slots[i].hash};
+            }
+            for (base_node<T, Tag>* cur = other.head; cur != nullptr; cur = cur->next) {
+                base_node<T, Tag>* copy = translate(cur);
+                copy->next = translate(cur->next);
+                copy->prev = translate(cur->prev);
+            }
+            head = translate(other.head);
+            tail = translate(other.tail);
+            count = other.count;
+        }
+
+        // Forgets all nodes without touching them; their owner frees them.
+        void detach_all() {
+            slots.clear();
+            head = nullptr;
+            tail = nullptr;
+            count = 0;
+        }
+
+        void reserve(std::size_t new_count) {
+            if (new_count * 4 > slots.size() * 3) {
+                rehash(capacity_for(new_count));
+            }
+        }
+
+        friend void swap(hash_index& first, hash_index& second) {
+            std::swap(first.slots, second.slots);
+            std::swap(first.head, second.head);
+            std::swap(first.tail, second.tail);
+            std::swap(first.count, second.count);
+            std::swap(first.functions, second.functions);
+        }
+
+    private:
+        struct slot {
+            base_node<T, Tag>* node;
+            std::size_t hash;
+        };
+
+        template<class K>
+        std::size_t hash_of(const K& value) const {
+            // spreads identity hashes (std::hash of integers) over the high bits too
+            auto bits = static_cast<std::uint64_t>(functions.hash(value)) * 0x9E3779B97F4A7C15ull;
+            return static_cast<std::size_t>(bits ^ (bits >> 32));
+        }
+
+        [[nodiscard]] std::size_t mask() const {
+            return slots.size() - 1;
+        }
+
+        static std::size_t capacity_for(std::size_t new_count) {
+            std::size_t capacity = 16;
+            while (new_count * 4 > capacity * 3) {
+                capacity *= 2;
+            }
+            return capacity;
+        }
+
+        void place(base_node<T, Tag>* node, std::size_t hash) {
+            std::size_t i = hash & mask();
+            while (slots[i].node != nullptr) {
+                i = (i + 1) & mask();
+            }
+            slots[i] = {node, hash};
+        }
+
+        void rehash(std::size_t capacity) {
+            std::vector<slot> old_slots(capacity, slot{nullptr, 0});
+            std::swap(slots, old_slots);
+            for (const slot& entry : old_slots) {
+                if (entry.node != nullptr) {
+                    place(entry.node, entry.hash);
+                }
+            }
+        }
+
+        void append(base_node<T, Tag>* node) {
+            node->prev = tail;
+            node->next = nullptr;
+            if (tail != nullptr) {
+                tail->next = node;
+            } else {
+                head = node;
+            }
+            tail = node;
+        }
+
+        std::vector<slot> slots;
+        base_node<T, Tag>* head = nullptr;
+        base_node<T, Tag>* tail = nullptr;
+        std::size_t count = 0;
+        hashed<Hash, Equal> functions;
+    };
+}
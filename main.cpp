@@ -1,6 +1,16 @@
+#include <atomic>
+#include <cstdlib>
+#include <list>
+#include <new>
 #include <random>
+#include <thread>
 
 #include "bimap.h"
+#include "compact_bimap.h"
+#include "concurrent_bimap.h"
+#include "frozen_bimap.h"
+#include "mapped_bimap.h"
+#include "snapshot_bimap.h"
 #include "test-classes.h"
 #include "gtest/gtest.h"
 
@@ -415,3 +425,1466 @@ TEST(bimap, equivalence) {
   EXPECT_EQ(a.end_left().flip(), a.end_right());
   EXPECT_EQ(a.end_right().flip(), a.end_left());
 }
+
+TEST(bimap, pool_allocator) {
+  bmp::bimap<int, int, std::less<>, std::less<>, bmp::pool_allocator<int>> b;
+  for (int i = 0; i < 1000; i++) {
+    b.insert(i, -i);
+  }
+  auto first = b.begin_left().get_node();
+  b.erase_left(0);
+  b.insert(2000, 2000);
+  // the freed slot is reused by the next node
+  EXPECT_EQ(b.find_left(2000).get_node(), first);
+  EXPECT_EQ(b.size(), 1000);
+
+  auto copy = b;
+  EXPECT_EQ(copy, b);
+  EXPECT_NE(copy.get_allocator(), b.get_allocator());
+
+  bmp::bimap<int, int, std::less<>, std::less<>, bmp::pool_allocator<int>> assigned;
+  auto pool = assigned.get_allocator().get_pool();
+  assigned = b;
+  EXPECT_EQ(assigned, b);
+  EXPECT_EQ(assigned.get_allocator().get_pool(), pool);
+  EXPECT_NE(assigned.get_allocator().get_pool(), b.get_allocator().get_pool());
+
+  auto moved = std::move(copy);
+  EXPECT_EQ(moved, b);
+  moved.erase_left(moved.begin_left(), moved.end_left());
+  EXPECT_TRUE(moved.empty());
+}
+
+TEST(bimap, pmr_allocator) {
+  std::pmr::monotonic_buffer_resource resource;
+  bmp::pmr::bimap<int, int> b(&resource);
+  b.insert(1, 2);
+  b.insert(3, 4);
+  EXPECT_EQ(b.get_allocator().resource(), &resource);
+
+  bmp::pmr::bimap<int, int> c;
+  c = b;
+  EXPECT_EQ(c.get_allocator().resource(), std::pmr::get_default_resource());
+  EXPECT_EQ(c, b);
+
+  c = std::move(b);
+  EXPECT_EQ(c.at_left(3), 4);
+}
+
+TEST(bimap, try_insert) {
+  bmp::bimap<int, int> b;
+  auto [it, inserted] = b.try_insert(1, 2);
+  EXPECT_TRUE(inserted);
+  EXPECT_EQ(*it, 1);
+
+  b.try_insert(3, 4);
+  auto left_conflict = b.try_insert(1, 10);
+  EXPECT_FALSE(left_conflict.second);
+  EXPECT_EQ(*left_conflict.first.flip(), 2);
+
+  auto right_conflict = b.try_insert(5, 4);
+  EXPECT_FALSE(right_conflict.second);
+  EXPECT_EQ(*right_conflict.first, 3);
+  EXPECT_EQ(b.size(), 2);
+}
+
+TEST(bimap, insert_hint) {
+  bmp::bimap<int, int> b;
+  for (int i = 0; i < 100; i++) {
+    EXPECT_EQ(*b.insert_hint(b.end_left(), i * 2, -i), i * 2);
+  }
+  auto it = b.insert_hint(b.find_left(10), 9, 1000);
+  EXPECT_EQ(*++it, 10);
+  // wrong hints still insert at the right place
+  b.insert_hint(b.begin_left(), 301, 301);
+  b.insert_hint(b.end_left(), 7, 7);
+  EXPECT_EQ(b.insert_hint(b.end_left(), 301, 0), b.end_left());
+  EXPECT_EQ(b.size(), 103);
+
+  int previous = -1;
+  for (auto lit = b.begin_left(); lit != b.end_left(); lit++) {
+    EXPECT_GT(*lit, previous);
+    EXPECT_EQ(b.at_right(*lit.flip()), *lit);
+    previous = *lit;
+  }
+}
+
+TEST(bimap, erase_iterator_does_not_compare) {
+  static size_t calls = 0;
+  struct counting_less {
+    bool operator()(int a, int b) const {
+      calls++;
+      return a < b;
+    }
+  };
+  bmp::bimap<int, int, counting_less, counting_less> b;
+  for (int i = 0; i < 1000; i++) {
+    b.insert((i * 37) % 1000, i);
+  }
+  auto first = b.find_left(100);
+  auto last = b.find_left(900);
+
+  calls = 0;
+  b.erase_left(b.begin_left());
+  b.erase_right(b.begin_right());
+  b.erase_left(first, last);
+  EXPECT_EQ(calls, 0);
+  EXPECT_EQ(b.size(), 198);
+  EXPECT_EQ(*b.lower_bound_left(100), 900);
+}
+
+TEST(bimap, build_from_sorted) {
+  std::vector<std::pair<int, int>> data;
+  for (int i = 0; i < 1000; i++) {
+    data.emplace_back(i, (i * 7919) % 1000);
+  }
+  data.emplace_back(1000, 0);
+  data.emplace_back(1000, 1);
+
+  bmp::bimap<int, int> b(bmp::sorted_left, data.begin(), data.end());
+  bmp::bimap<int, int> expected;
+  for (auto const &p : data) {
+    expected.insert(p.first, p.second);
+  }
+  EXPECT_EQ(b.size(), 1000);
+  EXPECT_EQ(b, expected);
+  EXPECT_EQ(*b.lower_bound_right(500).flip(), 500);
+  EXPECT_EQ(*--b.end_right(), 999);
+
+  b.insert(-1, -1);
+  b.erase_left(500);
+  EXPECT_EQ(*b.begin_left(), -1);
+  EXPECT_EQ(b.find_right(500), b.end_right());
+
+  std::vector<std::pair<int, int>> unsorted = {{1, 1}, {0, 0}};
+  EXPECT_THROW(b.assign_sorted(unsorted.begin(), unsorted.end()),
+               std::invalid_argument);
+  EXPECT_EQ(b.size(), 1000);
+
+  b.assign_sorted(data.begin(), data.begin() + 10);
+  EXPECT_EQ(b.size(), 10);
+}
+
+// The allocation after the next allocations_until_failure ones throws; a negative
+// count never fails.
+std::atomic<long> allocations_until_failure{-1};
+
+void *operator new(std::size_t size) {
+  if (allocations_until_failure.load(std::memory_order_relaxed) >= 0 && allocations_until_failure.fetch_sub(1) == 0) {
+    throw std::bad_alloc();
+  }
+  void *result = std::malloc(size == 0 ? 1 : size);
+  if (result == nullptr) {
+    throw std::bad_alloc();
+  }
+  return result;
+}
+
+// not inlined, so that the compiler does not take free() for a mismatched delete
+[[gnu::noinline]] void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+[[gnu::noinline]] void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+
+// Lets every allocation of the build fail in turn, also those after a tree is
+// linked, and checks that each node is freed exactly once.
+template <typename CompareRight> void check_sorted_build_failures() {
+  using map_t = bmp::bimap<int, int, std::less<int>, CompareRight, tracking_allocator<int>>;
+  std::vector<std::pair<int, int>> data;
+  for (int i = 0; i < 200; i++) {
+    data.emplace_back(i, (i * 7919) % 200);
+  }
+  tracked.blocks.reserve(1000);
+  for (long failure = 0;; failure++) {
+    bool built = false;
+    allocations_until_failure = failure;
+    try {
+      map_t b(bmp::sorted_left, data.begin(), data.end());
+      allocations_until_failure = -1;
+      EXPECT_EQ(b.size(), 200);
+      built = true;
+    } catch (const std::bad_alloc &) {
+    }
+    allocations_until_failure = -1;
+    EXPECT_EQ(tracked.live, 0);
+    EXPECT_EQ(tracked.double_frees, 0);
+    tracked.release_all();
+    if (built) {
+      EXPECT_GT(failure, 0);
+      break;
+    }
+  }
+}
+
+TEST(bimap, build_from_sorted_failures) {
+  check_sorted_build_failures<bmp::ordered<std::less<int>, bmp::treap>>();
+  check_sorted_build_failures<bmp::ordered<std::less<int>, bmp::simd_btree>>();
+  check_sorted_build_failures<bmp::hashed<std::hash<int>>>();
+}
+
+TEST(bimap, copy_keeps_structure) {
+  static size_t calls = 0;
+  struct counting_less {
+    bool operator()(int a, int b) const {
+      calls++;
+      return a < b;
+    }
+  };
+  bmp::bimap<int, int, counting_less, counting_less> b;
+  std::mt19937 e(seed);
+  for (int i = 0; i < 1000; i++) {
+    b.insert(e() % 5000, e() % 5000);
+  }
+
+  calls = 0;
+  auto copy = b;
+  EXPECT_EQ(calls, 0);
+  EXPECT_EQ(copy, b);
+
+  auto it = b.begin_left();
+  for (auto cit = copy.begin_left(); cit != copy.end_left(); cit++, it++) {
+    EXPECT_NE(cit.get_node(), it.get_node());
+    EXPECT_EQ(cit.get_node()->get_size(), it.get_node()->get_size());
+    EXPECT_EQ(*cit.flip(), *it.flip());
+  }
+
+  copy.erase_left(copy.begin_left(), copy.find_left(*copy.lower_bound_left(2500)));
+  copy.insert(-1, -1);
+  EXPECT_EQ(b.find_left(-1), b.end_left());
+  EXPECT_EQ(*copy.begin_right(), -1);
+}
+
+TEST(bimap, degenerate_tree) {
+  // ascending insertion leaves a splay tree that is a single left path
+  bmp::bimap<int, int> b;
+  const int total = 10'000'000;
+  for (int i = 0; i < total; i++) {
+    b.insert(i, i);
+  }
+  EXPECT_EQ(b.size(), total);
+  EXPECT_EQ(b.at_left(0), 0);
+  // splays the deepest node of both trees
+  EXPECT_TRUE(b.erase_left(0));
+  EXPECT_EQ(*b.begin_right(), 1);
+
+  b.clear();
+  EXPECT_TRUE(b.empty());
+  EXPECT_EQ(b.begin_left(), b.end_left());
+
+  for (int i = total; i > 0; i--) {
+    b.insert(i, i);
+  }
+  EXPECT_EQ(*b.begin_left(), 1);
+}
+
+template <typename Node> size_t check_subtree(const Node *node, size_t depth, size_t &max_depth) {
+  if (node == nullptr) {
+    return 0;
+  }
+  max_depth = std::max(max_depth, depth);
+  if (node->left != nullptr) {
+    EXPECT_EQ(node->left->parent, node);
+  }
+  if (node->right != nullptr) {
+    EXPECT_EQ(node->right->parent, node);
+  }
+  size_t size = 1 + check_subtree(node->left, depth + 1, max_depth) +
+                check_subtree(node->right, depth + 1, max_depth);
+  EXPECT_EQ(node->get_size(), size);
+  return size;
+}
+
+template <typename Node> int black_height(const Node *node) {
+  if (node == nullptr) {
+    return 1;
+  }
+  bool red = node->get_balance_data() != 0;
+  if (red) {
+    EXPECT_FALSE(node->left != nullptr && node->left->get_balance_data() != 0);
+    EXPECT_FALSE(node->right != nullptr && node->right->get_balance_data() != 0);
+  }
+  int left = black_height(node->left);
+  EXPECT_EQ(left, black_height(node->right));
+  return left + (red ? 0 : 1);
+}
+
+template <typename Node> void treap_heap(const Node *node) {
+  for (const Node *child : {node->left, node->right}) {
+    if (child != nullptr) {
+      EXPECT_LE(bmp::treap::priority(child), bmp::treap::priority(node));
+      treap_heap(child);
+    }
+  }
+}
+
+template <typename Node> const Node *tree_root(const Node *node) {
+  while (node != nullptr && node->parent != nullptr) {
+    node = node->parent;
+  }
+  return node;
+}
+
+template <typename Balance> void check_balance_policy(bool red_black) {
+  using cmp = bmp::ordered<std::less<int>, Balance>;
+  bmp::bimap<int, int, cmp, cmp> b;
+  std::map<int, int> left_view;
+
+  std::mt19937 e(seed);
+  std::vector<std::pair<int, int>> sorted;
+  for (int i = 0; i < 2000; i++) {
+    sorted.emplace_back(i * 3, static_cast<int>(e() % 100000));
+  }
+  b.assign_sorted(sorted.begin(), sorted.end());
+  for (auto it = b.begin_left(); it != b.end_left(); it++) {
+    left_view[*it] = *it.flip();
+  }
+
+  for (size_t i = 0; i < 20000; i++) {
+    if (e() % 3 != 0 || b.empty()) {
+      int l = e() % 10000, r = e() % 100000;
+      if (b.insert(l, r) != b.end_left()) {
+        left_view[l] = r;
+      }
+    } else {
+      auto it = b.lower_bound_left(e() % 10000);
+      if (it == b.end_left()) {
+        it = b.begin_left();
+      }
+      left_view.erase(*it);
+      if (e() % 2 == 0) {
+        b.erase_left(it);
+      } else {
+        b.erase_right(it.flip());
+      }
+    }
+    if (i % 1000 == 0) {
+      ASSERT_EQ(b.size(), left_view.size());
+      auto lit = b.begin_left();
+      for (auto const &p : left_view) {
+        EXPECT_EQ(*lit, p.first);
+        EXPECT_EQ(*lit.flip(), p.second);
+        lit++;
+      }
+      size_t left_depth = 0, right_depth = 0;
+      auto *left_root = tree_root(b.begin_left().get_node());
+      auto *right_root = tree_root(b.begin_right().get_node());
+      EXPECT_EQ(check_subtree(left_root, 0, left_depth), b.size());
+      EXPECT_EQ(check_subtree(right_root, 0, right_depth), b.size());
+      EXPECT_LE(left_depth, 4 * std::log2(b.size() + 1));
+      EXPECT_LE(right_depth, 4 * std::log2(b.size() + 1));
+      if (red_black) {
+        EXPECT_EQ(left_root->get_balance_data(), 0);
+        black_height(left_root);
+        black_height(right_root);
+      }
+    }
+  }
+}
+
+TEST(bimap_balance, red_black) { check_balance_policy<bmp::red_black>(true); }
+
+TEST(bimap_balance, treap) { check_balance_policy<bmp::treap>(false); }
+
+TEST(bimap_balance, mixed_policies) {
+  bmp::bimap<int, int, bmp::ordered<std::less<int>, bmp::red_black>,
+             bmp::ordered<std::greater<int>, bmp::treap>>
+      b;
+  for (int i = 0; i < 100000; i++) {
+    b.insert(i, i);
+  }
+  size_t left_depth = 0, right_depth = 0;
+  check_subtree(tree_root(b.begin_left().get_node()), 0, left_depth);
+  check_subtree(tree_root(b.begin_right().get_node()), 0, right_depth);
+  EXPECT_LE(left_depth, 2 * std::log2(b.size() + 1));
+  EXPECT_LE(right_depth, 4 * std::log2(b.size() + 1));
+  EXPECT_EQ(*b.begin_right(), 99999);
+
+  auto copy = b;
+  EXPECT_EQ(copy, b);
+  black_height(tree_root(copy.begin_left().get_node()));
+}
+
+TEST(bimap_balance, treap_copy) {
+  using cmp = bmp::ordered<std::less<int>, bmp::treap>;
+  bmp::bimap<int, int, cmp, cmp> b;
+  for (int i = 0; i < 100000; i++) {
+    b.insert(i, -i);
+  }
+  auto copy = b;
+  EXPECT_EQ(copy, b);
+  size_t left_depth = 0, right_depth = 0;
+  auto *left_root = tree_root(copy.begin_left().get_node());
+  auto *right_root = tree_root(copy.begin_right().get_node());
+  EXPECT_EQ(check_subtree(left_root, 0, left_depth), b.size());
+  EXPECT_EQ(check_subtree(right_root, 0, right_depth), b.size());
+  treap_heap(left_root);
+  treap_heap(right_root);
+  EXPECT_LE(left_depth, 4 * std::log2(b.size() + 1));
+  EXPECT_LE(right_depth, 4 * std::log2(b.size() + 1));
+  copy.insert(100000, 1);
+  EXPECT_EQ(copy.at_left(100000), 1);
+}
+
+struct final_greater final {
+  bool operator()(int a, int b) const { return a > b; }
+};
+
+bool less_by_pointer(const int &a, const int &b) { return a < b; }
+
+TEST(bimap_balance, function_pointer_and_final_comparators) {
+  using by_pointer = bmp::ordered<bool (*)(const int &, const int &), bmp::red_black>;
+  by_pointer less(&less_by_pointer);
+  bmp::bimap<int, int, by_pointer, bmp::ordered<final_greater, bmp::treap>> b(less);
+  for (int i = 0; i < 1000; i++) {
+    b.insert(i, i);
+  }
+  EXPECT_EQ(*b.begin_left(), 0);
+  EXPECT_EQ(*b.begin_right(), 999);
+  EXPECT_EQ(b.at_left(500), 500);
+  auto copy = b;
+  EXPECT_EQ(copy, b);
+}
+
+TEST(bimap_balance, parametrized_comparator) {
+  using vec = std::pair<int, int>;
+  using cmp = bmp::ordered<vector_compare, bmp::red_black>;
+  bmp::bimap<vec, vec, cmp, cmp> b(vector_compare(vector_compare::manhattan));
+  b.insert({0, 1}, {35, 3});
+  b.insert({20, -20}, {20, -20});
+  b.insert({35, 3}, {3, -1});
+  EXPECT_EQ(*b.begin_right(), vec(3, -1));
+  EXPECT_EQ(*--b.end_left(), vec(20, -20));
+}
+
+TEST(bimap, bounds_of_present_values) {
+  bmp::bimap<int, int> b;
+  EXPECT_EQ(b.lower_bound_left(1), b.end_left());
+  EXPECT_EQ(b.upper_bound_right(1), b.end_right());
+
+  for (int i = 0; i < 10; i++) {
+    b.insert(i * 2, i);
+  }
+  EXPECT_EQ(*b.lower_bound_left(4), 4);
+  EXPECT_EQ(*b.upper_bound_left(4), 6);
+  EXPECT_EQ(*b.upper_bound_right(3), 4);
+  EXPECT_EQ(b.upper_bound_left(18), b.end_left());
+}
+
+TEST(bimap_balance, splay_on_access) {
+  using cmp = bmp::ordered<std::less<int>, bmp::splay_on_access>;
+  bmp::bimap<int, int, cmp> b;
+  for (int i = 0; i < 1000; i++) {
+    b.insert(i, -i);
+  }
+  const auto &cb = b;
+  EXPECT_EQ(cb.at_left(500), -500);
+  EXPECT_EQ(tree_root(cb.begin_left().get_node())->get_value(), 500);
+  EXPECT_EQ(*cb.lower_bound_left(3), 3);
+  EXPECT_EQ(tree_root(cb.begin_left().get_node())->get_value(), 3);
+  EXPECT_EQ(*cb.nth_left(800), 800);
+  EXPECT_EQ(tree_root(cb.begin_left().get_node())->get_value(), 800);
+  EXPECT_EQ(cb.rank_left(100), 100);
+  auto *rank_root = tree_root(cb.begin_left().get_node());
+  EXPECT_TRUE(rank_root->get_value() == 99 || rank_root->get_value() == 100);
+
+  // the right side is a plain splay tree, lookups leave it alone
+  auto *right_root = tree_root(cb.begin_right().get_node());
+  EXPECT_EQ(cb.at_right(-700), 700);
+  EXPECT_EQ(tree_root(cb.begin_right().get_node()), right_root);
+
+  size_t depth = 0;
+  EXPECT_EQ(check_subtree(tree_root(cb.begin_left().get_node()), 0, depth), 1000);
+}
+
+TEST(bimap, order_statistics) {
+  bmp::bimap<int, int> b;
+  std::set<int> lefts, rights;
+  std::mt19937 e(seed);
+  for (int i = 0; i < 2000; i++) {
+    int l = e() % 10000, r = e() % 10000;
+    if (b.insert(l, r) != b.end_left()) {
+      lefts.insert(l);
+      rights.insert(r);
+    }
+  }
+  std::vector<int> sorted_lefts(lefts.begin(), lefts.end());
+  std::vector<int> sorted_rights(rights.begin(), rights.end());
+
+  for (size_t k = 0; k < sorted_lefts.size(); k += 7) {
+    EXPECT_EQ(*b.nth_left(k), sorted_lefts[k]);
+    EXPECT_EQ(*b.nth_right(k), sorted_rights[k]);
+    EXPECT_EQ(b.rank_left(sorted_lefts[k]), k);
+    EXPECT_EQ(b.rank_right(sorted_rights[k] + 1), k + 1);
+    EXPECT_EQ(b.index_of(b.find_left(sorted_lefts[k])), k);
+    EXPECT_EQ(b.index_of(b.find_right(sorted_rights[k])), k);
+  }
+  EXPECT_EQ(b.nth_left(b.size()), b.end_left());
+  EXPECT_EQ(b.index_of(b.end_right()), b.size());
+
+  auto expected = std::distance(lefts.lower_bound(1000), lefts.lower_bound(5000));
+  EXPECT_EQ(b.count_range_left(1000, 5000), expected);
+  EXPECT_EQ(b.count_range_left(5000, 1000), 0);
+  EXPECT_EQ(b.count_range_right(-5, 20000), b.size());
+}
+
+template <bool Threaded> void check_compact_bimap() {
+  bmp::compact_bimap<int, int, std::less<int>, std::less<int>, Threaded> b;
+  std::map<int, int> left_view, right_view;
+
+  std::mt19937 e(seed);
+  for (size_t i = 0; i < 30000; i++) {
+    if (e() % 10 > 2 || b.empty()) {
+      int l = e() % 20000, r = e() % 20000;
+      bool inserted = b.insert(l, r) != b.end_left();
+      EXPECT_EQ(inserted, !left_view.count(l) && !right_view.count(r));
+      if (inserted) {
+        left_view[l] = r;
+        right_view[r] = l;
+      }
+    } else {
+      auto it = b.lower_bound_left(e() % 20000);
+      if (it == b.end_left()) {
+        it = b.begin_left();
+      }
+      int l = *it, r = *it.flip();
+      auto next = left_view.upper_bound(l);
+      left_view.erase(l);
+      right_view.erase(r);
+      switch (e() % 3) {
+      case 0: {
+        auto after = b.erase_left(it);
+        EXPECT_EQ(after == b.end_left(), next == left_view.end());
+        if (after != b.end_left()) {
+          EXPECT_EQ(*after, next->first);
+        }
+        break;
+      }
+      case 1:
+        EXPECT_TRUE(b.erase_right(r));
+        break;
+      default:
+        EXPECT_TRUE(b.erase_left(l));
+      }
+    }
+    if (i % 1000 == 0) {
+      ASSERT_EQ(b.size(), left_view.size());
+      auto lit = b.begin_left();
+      for (auto const &p : left_view) {
+        EXPECT_EQ(*lit, p.first);
+        EXPECT_EQ(*lit.flip(), p.second);
+        EXPECT_EQ(b.at_right(p.second), p.first);
+        ++lit;
+      }
+      auto rit = b.end_right();
+      for (auto p = right_view.rbegin(); p != right_view.rend(); ++p) {
+        --rit;
+        EXPECT_EQ(*rit, p->first);
+      }
+    }
+  }
+  EXPECT_THROW(b.at_left(-1), std::out_of_range);
+  EXPECT_EQ(b.find_right(-1), b.end_right());
+  EXPECT_FALSE(b.erase_left(-1));
+}
+
+TEST(compact_bimap, threaded) { check_compact_bimap<true>(); }
+
+TEST(compact_bimap, unthreaded) { check_compact_bimap<false>(); }
+
+TEST(compact_bimap, layout) {
+  using threaded = bmp::compact_bimap<uint32_t, uint32_t>;
+  using unthreaded = bmp::compact_bimap<uint32_t, uint32_t, std::less<uint32_t>,
+                                        std::less<uint32_t>, false>;
+  EXPECT_EQ(threaded::node_size, 40);
+  EXPECT_EQ(unthreaded::node_size, 24);
+
+  unthreaded b;
+  b.reserve(1 << 16);
+  for (uint32_t i = 0; i < (1 << 16); i++) {
+    b.insert(i, ~i);
+  }
+  EXPECT_EQ(*b.begin_right(), ~uint32_t(0xffff));
+  EXPECT_EQ(*b.lower_bound_left(100).flip(), ~uint32_t(100));
+  auto copy = b;
+  EXPECT_EQ(copy, b);
+}
+
+TEST(unordered_bimap, compare_to_two_maps) {
+  bmp::unordered_bimap<int, int> b;
+  std::map<int, int> left_view, right_view;
+  std::mt19937 e(seed);
+  std::vector<int> inserted;
+  for (size_t i = 0; i < 20000; i++) {
+    if (inserted.empty() || e() % 3 != 0) {
+      int l = static_cast<int>(e() % 5000);
+      int r = static_cast<int>(e() % 5000);
+      bool fresh = left_view.count(l) == 0 && right_view.count(r) == 0;
+      EXPECT_EQ(b.insert(l, r) != b.end_left(), fresh);
+      if (fresh) {
+        left_view[l] = r;
+        right_view[r] = l;
+        inserted.push_back(l);
+      }
+    } else {
+      size_t index = e() % inserted.size();
+      int l = inserted[index];
+      std::swap(inserted[index], inserted.back());
+      inserted.pop_back();
+      int r = left_view[l];
+      left_view.erase(l);
+      right_view.erase(r);
+      if (e() % 2 == 0) {
+        EXPECT_TRUE(b.erase_right(r));
+      } else {
+        b.erase_left(b.find_left(l));
+      }
+    }
+    if (i % 1000 == 0) {
+      ASSERT_EQ(b.size(), left_view.size());
+      for (auto const &p : left_view) {
+        EXPECT_EQ(b.at_left(p.first), p.second);
+        EXPECT_EQ(*b.find_right(p.second).flip(), p.first);
+      }
+      size_t visited = 0;
+      for (auto it = b.begin_right(); it != b.end_right(); ++it) {
+        EXPECT_EQ(right_view.at(*it), *it.flip());
+        visited++;
+      }
+      EXPECT_EQ(visited, right_view.size());
+    }
+  }
+  EXPECT_THROW(b.at_left(-1), std::out_of_range);
+  EXPECT_EQ(b.find_right(-1), b.end_right());
+  EXPECT_FALSE(b.erase_left(-1));
+}
+
+TEST(unordered_bimap, insertion_order_and_equality) {
+  bmp::unordered_bimap<std::string, int> a;
+  a.insert("one", 1);
+  a.insert("two", 2);
+  a.insert("three", 3);
+  std::vector<std::string> order;
+  for (auto it = a.begin_left(); it != a.end_left(); ++it) {
+    order.push_back(*it);
+  }
+  EXPECT_EQ(order, (std::vector<std::string>{"one", "two", "three"}));
+  EXPECT_EQ(*--a.end_right(), 3);
+
+  bmp::unordered_bimap<std::string, int> b;
+  b.insert("three", 3);
+  b.insert("one", 1);
+  b.insert("two", 2);
+  EXPECT_EQ(a, b);
+  b.erase_right(2);
+  b.insert("two", 4);
+  EXPECT_NE(a, b);
+
+  auto copy = a;
+  EXPECT_EQ(copy, a);
+  copy.erase_left("two");
+  EXPECT_EQ(copy.size(), 2);
+  EXPECT_EQ(a.at_right(2), "two");
+  EXPECT_EQ(copy.find_left("two"), copy.end_left());
+}
+
+TEST(bimap, mixed_indices) {
+  using mixed = bmp::bimap<int, std::string, std::less<int>, bmp::hashed<std::hash<std::string>>>;
+  std::vector<std::pair<int, std::string>> input;
+  for (int i = 0; i < 1000; i++) {
+    input.emplace_back(i * 2, "id" + std::to_string(i % 700));
+  }
+  mixed b(bmp::sorted_left, input.begin(), input.end());
+  ASSERT_EQ(b.size(), 700);
+  EXPECT_EQ(b.at_right("id5"), 10);
+  EXPECT_EQ(*b.find_left(1398).flip(), "id699");
+  EXPECT_EQ(b.find_left(1400), b.end_left());
+
+  EXPECT_EQ(*b.lower_bound_left(101), 102);
+  EXPECT_EQ(b.count_range_left(100, 200), 50);
+  EXPECT_EQ(*b.nth_left(3), 6);
+  EXPECT_EQ(*b.begin_right(), "id0");
+
+  EXPECT_EQ(b.insert(-1, "id5"), b.end_left());
+  b.insert(-1, "new");
+  EXPECT_EQ(*b.begin_left(), -1);
+  EXPECT_EQ(*--b.end_right(), "new");
+  b.erase_right("id0");
+  EXPECT_EQ(*++b.begin_left(), 2);
+
+  auto copy = b;
+  EXPECT_EQ(copy, b);
+  copy.erase_left(2);
+  EXPECT_NE(copy, b);
+
+  bmp::bimap<std::string, int, bmp::hashed<std::hash<std::string>>> flipped;
+  for (auto it = b.begin_left(); it != b.end_left(); ++it) {
+    flipped.insert(*it.flip(), *it);
+  }
+  EXPECT_EQ(*flipped.lower_bound_right(1), 2);
+  EXPECT_EQ(flipped.at_left("new"), -1);
+}
+
+struct string_hash {
+  using is_transparent = void;
+
+  size_t operator()(std::string_view s) const { return std::hash<std::string_view>()(s); }
+};
+
+TEST(bimap, transparent_lookup) {
+  bmp::bimap<std::string, std::string, std::less<>, std::less<>> b;
+  b.insert("apple", "red");
+  b.insert("banana", "yellow");
+  b.insert("cherry", "dark red");
+
+  std::string_view key = "banana";
+  EXPECT_EQ(b.at_left(key), "yellow");
+  EXPECT_EQ(*b.find_right("red").flip(), "apple");
+  EXPECT_EQ(*b.lower_bound_left(std::string_view("b")), "banana");
+  EXPECT_EQ(*b.upper_bound_right("red"), "yellow");
+  EXPECT_EQ(b.rank_left("c"), 2);
+  EXPECT_EQ(b.count_range_left("a", "c"), 2);
+  EXPECT_THROW(b.at_right(std::string_view("green")), std::out_of_range);
+  EXPECT_TRUE(b.erase_left(key));
+  EXPECT_FALSE(b.erase_right("yellow"));
+  EXPECT_EQ(b.erase_left(b.begin_left()), b.find_left("cherry"));
+
+  bmp::bimap<std::string, int, bmp::hashed<string_hash, std::equal_to<>>> h;
+  h.insert("one", 1);
+  h.insert("two", 2);
+  EXPECT_EQ(h.at_left(std::string_view("two")), 2);
+  EXPECT_TRUE(h.erase_left("one"));
+  EXPECT_EQ(h.find_left("one"), h.end_left());
+}
+
+struct counted_string {
+  static inline size_t constructions = 0;
+
+  explicit counted_string(std::string_view s) : value(s) { constructions++; }
+  counted_string(size_t n, char c) : value(n, c) { constructions++; }
+
+  bool operator<(const counted_string &other) const { return value < other.value; }
+  friend bool operator<(const counted_string &a, std::string_view b) { return a.value < b; }
+  friend bool operator<(std::string_view a, const counted_string &b) { return a < b.value; }
+
+  std::string value;
+};
+
+TEST(bimap, emplace) {
+  bmp::bimap<counted_string, int, std::less<>> b;
+  counted_string::constructions = 0;
+
+  auto [it, inserted] = b.emplace(std::piecewise_construct, std::forward_as_tuple(3, 'a'), std::forward_as_tuple(1));
+  EXPECT_TRUE(inserted);
+  EXPECT_EQ((*it).value, "aaa");
+  EXPECT_EQ(counted_string::constructions, 1);
+
+  auto duplicate = b.emplace(std::piecewise_construct, std::forward_as_tuple("bbb"), std::forward_as_tuple(1));
+  EXPECT_FALSE(duplicate.second);
+  EXPECT_EQ(duplicate.first, it);
+  EXPECT_EQ(b.size(), 1);
+
+  counted_string::constructions = 0;
+  EXPECT_FALSE(b.try_emplace(std::string_view("aaa"), 2).second);
+  EXPECT_FALSE(b.try_emplace(std::string_view("ccc"), 1).second);
+  EXPECT_EQ(counted_string::constructions, 0);
+
+  auto fresh = b.try_emplace(std::string_view("ccc"), 2);
+  EXPECT_TRUE(fresh.second);
+  EXPECT_EQ(counted_string::constructions, 1);
+  EXPECT_EQ(b.at_right(2).value, "ccc");
+  EXPECT_EQ(*b.find_left(std::string_view("aaa")).flip(), 1);
+
+  bmp::bimap<std::string, std::string> plain;
+  plain.try_emplace(std::string("x"), std::string("y"));
+  EXPECT_EQ(plain.at_left("x"), "y");
+}
+
+TEST(bimap, node_handles) {
+  bmp::bimap<std::string, int> a, b;
+  a.insert("one", 1);
+  a.insert("two", 2);
+  a.insert("three", 3);
+  const std::string *stored = &*a.find_left("two");
+
+  auto handle = a.extract_left(a.find_left("two"));
+  ASSERT_FALSE(handle.empty());
+  EXPECT_EQ(handle.left(), "two");
+  EXPECT_EQ(handle.right(), 2);
+  EXPECT_EQ(a.size(), 2);
+  EXPECT_EQ(a.find_right(2), a.end_right());
+
+  auto result = b.insert(std::move(handle));
+  EXPECT_TRUE(result.inserted);
+  EXPECT_TRUE(result.node.empty());
+  EXPECT_EQ(&*result.position, stored);
+  EXPECT_EQ(b.at_right(2), "two");
+
+  b.insert("uno", 1);
+  auto blocked = b.insert(a.extract_right(1));
+  EXPECT_FALSE(blocked.inserted);
+  EXPECT_EQ(*blocked.position, "uno");
+  EXPECT_EQ(blocked.node.left(), "one");
+  EXPECT_TRUE(a.extract_left("missing").empty());
+  EXPECT_TRUE(b.insert(std::move(blocked.node)).node);
+
+  a.insert("four", 4);
+  a.insert("dos", 2);
+  const std::string *four = &*a.find_left("four");
+  b.merge(a);
+  EXPECT_EQ(b.size(), 4);
+  EXPECT_EQ(&*b.find_left("four"), four);
+  EXPECT_EQ(a.size(), 1);
+  EXPECT_EQ(a.at_left("dos"), 2);
+  EXPECT_EQ(b.at_left("three"), 3);
+  EXPECT_EQ(*b.begin_left(), "four");
+}
+
+template <typename Map> void check_batches() {
+  std::mt19937 e(seed);
+  for (size_t round = 0; round < 40; round++) {
+    Map batched, single;
+    size_t initial = e() % 2000;
+    for (size_t i = 0; i < initial; i++) {
+      int l = static_cast<int>(e() % 4000), r = static_cast<int>(e() % 4000);
+      batched.insert(l, r);
+      single.insert(l, r);
+    }
+
+    std::vector<std::pair<int, int>> pairs(e() % 3000);
+    for (auto &p : pairs) {
+      p = {static_cast<int>(e() % 4000), static_cast<int>(e() % 4000)};
+    }
+    if (round % 4 != 0) {
+      std::sort(pairs.begin(), pairs.end());
+    }
+    if (round % 4 == 1) {
+      pairs.erase(std::unique(pairs.begin(), pairs.end(),
+                              [](auto const &a, auto const &b) { return a.first == b.first; }),
+                  pairs.end());
+    }
+    auto inserted = batched.insert_batch(pairs.begin(), pairs.end());
+    ASSERT_EQ(inserted.size(), pairs.size());
+    for (size_t i = 0; i < pairs.size(); i++) {
+      EXPECT_EQ(inserted[i], single.insert(pairs[i].first, pairs[i].second) != single.end_left());
+    }
+    ASSERT_EQ(batched, single);
+    if constexpr (Map::left_tree_t::is_ordered && Map::right_tree_t::is_ordered) {
+      size_t index = 0;
+      for (auto it = batched.begin_right(); it != batched.end_right(); ++it, ++index) {
+        EXPECT_EQ(batched.nth_right(index), it);
+        EXPECT_EQ(batched.index_of(it.flip()), batched.rank_left(*it.flip()));
+      }
+    }
+
+    std::vector<int> keys(e() % 5000);
+    for (auto &k : keys) {
+      k = static_cast<int>(e() % 4000);
+    }
+    if (round % 2 == 0) {
+      std::sort(keys.begin(), keys.end());
+    }
+    auto found = batched.find_left_batch(keys.begin(), keys.end());
+    for (size_t i = 0; i < keys.size(); i++) {
+      EXPECT_EQ(found[i], batched.find_left(keys[i]));
+    }
+    auto erased = batched.erase_left_batch(keys.begin(), keys.end());
+    for (size_t i = 0; i < keys.size(); i++) {
+      EXPECT_EQ(erased[i], single.erase_left(keys[i]));
+    }
+    ASSERT_EQ(batched, single);
+    if (!single.empty()) {
+      EXPECT_EQ(*batched.begin_right(), *single.begin_right());
+      EXPECT_EQ(*--batched.end_right(), *--single.end_right());
+    }
+  }
+}
+
+TEST(bimap, batches) {
+  check_batches<bmp::bimap<int, int>>();
+  check_batches<bmp::bimap<int, int, bmp::ordered<std::less<int>, bmp::red_black>,
+                           bmp::ordered<std::less<int>, bmp::treap>>>();
+  check_batches<bmp::bimap<int, int, std::less<int>, bmp::hashed<std::hash<int>>>>();
+  check_batches<bmp::unordered_bimap<int, int>>();
+  check_batches<bmp::simd_bimap<int, int>>();
+}
+
+template <typename Map> void check_interleaved_lookups() {
+  std::mt19937 e(seed);
+  Map b;
+  std::vector<int> lefts, rights;
+  EXPECT_EQ(b.find_right_batch(lefts.begin(), lefts.end()).size(), 0);
+  for (int i = 0; i < 5000; i++) {
+    lefts.push_back(static_cast<int>(e() % 10000));
+    rights.push_back(static_cast<int>(e() % 10000));
+  }
+  EXPECT_EQ(b.find_left_batch(lefts.begin(), lefts.end()), std::vector<typename Map::left_iterator>(5000, b.end_left()));
+  for (int i = 0; i < 3000; i++) {
+    b.insert(lefts[i], rights[i]);
+  }
+
+  auto by_left = b.find_left_batch(lefts.begin(), lefts.end());
+  auto by_right = b.find_right_batch(rights.begin(), rights.end());
+  ASSERT_EQ(by_left.size(), lefts.size());
+  ASSERT_EQ(by_right.size(), rights.size());
+  for (size_t i = 0; i < lefts.size(); i++) {
+    EXPECT_EQ(by_left[i], b.find_left(lefts[i]));
+    EXPECT_EQ(by_right[i], b.find_right(rights[i]));
+  }
+
+  std::list<int> keys(lefts.begin(), lefts.begin() + 100);
+  auto from_list = b.find_left_batch(keys.begin(), keys.end());
+  EXPECT_TRUE(std::equal(from_list.begin(), from_list.end(), by_left.begin()));
+}
+
+TEST(bimap, interleaved_lookups) {
+  check_interleaved_lookups<bmp::bimap<int, int>>();
+  check_interleaved_lookups<bmp::bimap<int, int, bmp::ordered<std::less<int>, bmp::splay_on_access>,
+                                       bmp::ordered<std::less<int>, bmp::red_black>>>();
+  check_interleaved_lookups<bmp::unordered_bimap<int, int>>();
+  check_interleaved_lookups<bmp::simd_bimap<int, int>>();
+}
+
+TEST(concurrent_bimap, single_thread) {
+  bmp::concurrent_bimap<std::string, int> b(5);
+  EXPECT_EQ(b.get_shard_count(), 8);
+  EXPECT_TRUE(b.insert("one", 1));
+  EXPECT_TRUE(b.insert("two", 2));
+  EXPECT_FALSE(b.insert("one", 3));
+  EXPECT_FALSE(b.insert("three", 2));
+  EXPECT_EQ(b.size(), 2);
+  EXPECT_EQ(b.at_left("two"), 2);
+  EXPECT_EQ(b.find_right(1), "one");
+  EXPECT_EQ(b.find_left("three"), std::nullopt);
+  EXPECT_THROW(b.at_right(3), std::out_of_range);
+  EXPECT_TRUE(b.erase_right(1));
+  EXPECT_FALSE(b.erase_left("one"));
+  EXPECT_TRUE(b.insert("three", 1));
+  b.clear();
+  EXPECT_TRUE(b.empty());
+  EXPECT_EQ(b.find_left("two"), std::nullopt);
+}
+
+TEST(concurrent_bimap, hashed_sides) {
+  bmp::concurrent_bimap<int, int, bmp::hashed<std::hash<int>>, bmp::hashed<std::hash<int>>> b(2);
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_TRUE(b.insert(i, -i));
+  }
+  EXPECT_FALSE(b.insert(5, 1));
+  for (int i = 0; i < 1000; i += 2) {
+    EXPECT_TRUE(b.erase_right(-i));
+  }
+  EXPECT_EQ(b.size(), 500);
+  EXPECT_EQ(b.at_left(7), -7);
+  EXPECT_EQ(b.find_right(-8), std::nullopt);
+  size_t seen = 0;
+  b.for_each([&](int l, int r) {
+    EXPECT_EQ(l, -r);
+    seen++;
+  });
+  EXPECT_EQ(seen, 500);
+}
+
+std::size_t hash_by_pointer(const int &a) { return std::hash<int>()(a); }
+
+TEST(concurrent_bimap, stateful_comparators) {
+  // both functions are null pointers unless the shards get the given ones
+  using by_pointer = bmp::ordered<bool (*)(const int &, const int &), bmp::red_black>;
+  using hashed_by_pointer = bmp::hashed<std::size_t (*)(const int &)>;
+  bmp::concurrent_bimap<int, int, by_pointer, hashed_by_pointer> b(
+      4, by_pointer(&less_by_pointer), hashed_by_pointer(&hash_by_pointer));
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_TRUE(b.insert(i, -i));
+  }
+  EXPECT_FALSE(b.insert(5, 1));
+  EXPECT_EQ(b.at_left(7), -7);
+  EXPECT_EQ(b.find_right(-8), 8);
+  EXPECT_TRUE(b.erase_right(-9));
+  EXPECT_EQ(b.size(), 999);
+}
+
+TEST(concurrent_bimap, stress) {
+  bmp::concurrent_bimap<int, int, bmp::ordered<std::less<int>, bmp::splay_on_access>> b(4);
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < 4; t++) {
+    threads.emplace_back([&b, t] {
+      std::mt19937 e(seed + t);
+      for (int i = 0; i < 20000; i++) {
+        int l = static_cast<int>(e() % 500), r = static_cast<int>(e() % 500);
+        switch (e() % 5) {
+        case 0:
+          b.insert(l, r);
+          break;
+        case 1:
+          b.erase_left(l);
+          break;
+        case 2:
+          b.erase_right(r);
+          break;
+        default:
+          if (auto found = b.find_left(l)) {
+            auto back = b.find_right(*found);
+            EXPECT_TRUE(!back || *back == l || b.find_left(l) != found);
+          }
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  std::map<int, int> pairs;
+  std::set<int> rights;
+  b.for_each([&](int l, int r) {
+    EXPECT_TRUE(pairs.emplace(l, r).second);
+    EXPECT_TRUE(rights.insert(r).second);
+  });
+  EXPECT_EQ(pairs.size(), b.size());
+  for (auto const &[l, r] : pairs) {
+    EXPECT_EQ(b.at_right(r), l);
+    EXPECT_EQ(b.at_left(l), r);
+  }
+}
+
+TEST(snapshot_bimap, versions) {
+  bmp::snapshot_bimap<int, std::string> b;
+  auto empty = b.snapshot();
+  b.insert(1, "one");
+  b.insert(2, "two");
+  b.insert(3, "two");
+  EXPECT_TRUE(b.snapshot()->find_left(1) == b.snapshot()->end_left());
+  b.publish();
+  EXPECT_EQ(b.version(), 1);
+  EXPECT_TRUE(empty->empty());
+
+  auto first = b.snapshot();
+  EXPECT_EQ(first->size(), 2);
+  EXPECT_EQ(first->at_left(2), "two");
+  EXPECT_EQ(first->at_right("one"), 1);
+
+  b.erase_right("one");
+  b.insert(4, "four");
+  b.publish();
+  // the previous versions are held by empty and first, so these two are copies
+  b.erase_left(2);
+  b.publish();
+  // nobody holds version 2, the writes of the last two batches are replayed on it
+  b.insert(5, "five");
+  b.publish();
+  EXPECT_EQ(b.version(), 4);
+
+  EXPECT_EQ(first->size(), 2);
+  EXPECT_EQ(first->at_left(1), "one");
+  auto last = b.snapshot();
+  EXPECT_EQ(last->size(), 2);
+  EXPECT_EQ(last->at_left(4), "four");
+  EXPECT_EQ(last->at_right("five"), 5);
+  EXPECT_TRUE(last->find_left(2) == last->end_left());
+
+  b.insert(6, "six");
+  b.update([](auto &map) { map.erase_left(4); });
+  auto updated = b.snapshot();
+  EXPECT_EQ(updated->size(), 2);
+  EXPECT_EQ(updated->at_left(6), "six");
+  EXPECT_EQ(last->size(), 2);
+  EXPECT_EQ(last->at_left(4), "four");
+}
+
+TEST(snapshot_bimap, concurrent_readers) {
+  bmp::snapshot_bimap<int, int, std::less<int>, bmp::ordered<std::less<int>, bmp::red_black>> b;
+  std::atomic<bool> done{false};
+  std::vector<std::thread> readers;
+  for (uint32_t t = 0; t < 3; t++) {
+    readers.emplace_back([&b, &done] {
+      while (!done.load()) {
+        auto snapshot = b.snapshot();
+        std::size_t count = 0;
+        for (auto it = snapshot->begin_left(); it != snapshot->end_left(); ++it, ++count) {
+          EXPECT_EQ(snapshot->at_right(*it.flip()), *it);
+        }
+        EXPECT_EQ(count, snapshot->size());
+      }
+    });
+  }
+
+  std::mt19937 e(seed);
+  bmp::bimap<int, int> expected;
+  for (int batch = 0; batch < 200; batch++) {
+    for (int i = 0; i < 20; i++) {
+      int l = static_cast<int>(e() % 300), r = static_cast<int>(e() % 300);
+      if (e() % 3 == 0) {
+        b.erase_left(l);
+        expected.erase_left(l);
+      } else {
+        b.insert(l, r);
+        expected.try_insert(l, r);
+      }
+    }
+    b.publish();
+  }
+  done.store(true);
+  for (auto &reader : readers) {
+    reader.join();
+  }
+
+  auto snapshot = b.snapshot();
+  EXPECT_EQ(snapshot->size(), expected.size());
+  for (auto it = expected.begin_left(); it != expected.end_left(); ++it) {
+    EXPECT_EQ(snapshot->at_left(*it), *it.flip());
+  }
+}
+
+TEST(snapshot_bimap, held_snapshots) {
+  bmp::snapshot_bimap<int, int> b;
+  std::vector<bmp::snapshot_bimap<int, int>::snapshot_t> held;
+  for (int i = 0; i < 100; i++) {
+    held.push_back(b.snapshot());
+    b.insert(i, -i);
+    b.publish();
+  }
+  for (int i = 0; i < 100; i++) {
+    EXPECT_EQ(held[i]->size(), i);
+  }
+  held.clear();
+  b.erase_left(0);
+  b.publish();
+  b.insert(100, -100);
+  b.publish();
+  auto last = b.snapshot();
+  EXPECT_TRUE(last);
+  EXPECT_EQ(last->size(), 100);
+  EXPECT_EQ(last->at_right(-100), 100);
+  EXPECT_EQ(b.version(), 102);
+}
+
+template <typename Map> void check_parallel_build() {
+  std::mt19937 e(seed);
+  std::vector<std::pair<int, int>> data;
+  for (int i = 0; i < 60000; i++) {
+    data.emplace_back(static_cast<int>(e() % 80000), static_cast<int>(e() % 80000));
+  }
+
+  Map b = Map::build_parallel(data.begin(), data.end(), 4);
+  std::vector<std::pair<int, int>> sorted = data;
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](auto const &a, auto const &c) { return a.first < c.first; });
+  Map expected(bmp::sorted_left, sorted.begin(), sorted.end());
+  EXPECT_EQ(b.size(), expected.size());
+  EXPECT_EQ(b, expected);
+
+  Map copy(bmp::parallel, b, 4);
+  EXPECT_EQ(copy, b);
+  auto it = b.begin_left();
+  for (auto cit = copy.begin_left(); cit != copy.end_left(); cit++, it++) {
+    EXPECT_NE(cit.get_node(), it.get_node());
+    EXPECT_EQ(*cit.flip(), *it.flip());
+  }
+
+  copy.erase_left(copy.begin_left(), copy.lower_bound_left(40000));
+  EXPECT_TRUE(copy.insert(-1, -1) != copy.end_left());
+  EXPECT_EQ(copy.at_right(-1), -1);
+  EXPECT_EQ(b, expected);
+  EXPECT_EQ(Map(bmp::parallel, Map(), 4).size(), 0);
+}
+
+TEST(bimap, parallel_build_and_copy) {
+  check_parallel_build<bmp::bimap<int, int>>();
+  check_parallel_build<bmp::bimap<int, int, bmp::ordered<std::less<int>, bmp::red_black>,
+                                  bmp::ordered<std::less<int>, bmp::treap>>>();
+  check_parallel_build<bmp::bimap<int, int, std::less<int>, bmp::hashed<std::hash<int>>>>();
+  check_parallel_build<bmp::bimap<int, int, std::less<int>, std::less<int>,
+                                  bmp::pool_allocator<std::pair<int, int>>>>();
+  check_parallel_build<bmp::simd_bimap<int, int>>();
+}
+
+TEST(bimap, split_and_parallel_scans) {
+  bmp::bimap<int, int, std::less<int>, bmp::ordered<std::less<int>, bmp::red_black>> b;
+  for (int i = 0; i < 50000; i++) {
+    b.insert(i, (i * 7919) % 50000);
+  }
+
+  auto bounds = b.split_left(7);
+  EXPECT_EQ(bounds.size(), 8);
+  EXPECT_EQ(bounds.front(), b.begin_left());
+  EXPECT_EQ(bounds.back(), b.end_left());
+  for (size_t i = 0; i < 7; i++) {
+    size_t count = b.index_of(bounds[i + 1]) - b.index_of(bounds[i]);
+    EXPECT_TRUE(count == 50000 / 7 || count == 50000 / 7 + 1);
+  }
+  auto right_bounds = b.split_right(3);
+  EXPECT_EQ(*right_bounds[1], 50000 / 3);
+  EXPECT_EQ((bmp::bimap<int, int>().split_left(4).size()), 5);
+
+  std::atomic<long long> sum{0};
+  b.for_each_left([&sum](int l, int r) { sum += l - r; }, 4);
+  EXPECT_EQ(sum.load(), 0);
+  size_t less = 0;
+  for (auto it = b.begin_left(); it != b.end_left(); ++it) {
+    less += *it < *it.flip();
+  }
+  EXPECT_EQ(b.count_if([](int l, int r) { return l < r; }, 4), less);
+
+  // string concatenation is associative but not commutative
+  std::string digits = b.transform_reduce(std::string(), std::plus<>(), [](int l, int) {
+    return l % 1000 == 0 ? std::to_string(l / 1000 % 10) : std::string();
+  }, 4);
+  std::string expected;
+  for (int i = 0; i < 50; i++) {
+    expected += std::to_string(i % 10);
+  }
+  EXPECT_EQ(digits, expected);
+  auto pair_sum = [](int l, int r) { return l + r; };
+  EXPECT_EQ((bmp::bimap<int, int>().transform_reduce(5, std::plus<>(), pair_sum)), 5);
+}
+
+TEST(mapped_bimap, save_and_map) {
+  bmp::bimap<uint64_t, uint32_t, std::less<uint64_t>, std::greater<uint32_t>> b;
+  std::mt19937 e(seed);
+  for (int i = 0; i < 10000; i++) {
+    b.insert(e() % 100000, e() % 100000);
+  }
+  std::string path = testing::TempDir() + "bimap_snapshot.bin";
+  bmp::save(b, path);
+
+  bmp::mapped_bimap<uint64_t, uint32_t, std::less<uint64_t>, std::greater<uint32_t>> mapped(path);
+  EXPECT_EQ(mapped.size(), b.size());
+  auto it = b.begin_left();
+  for (auto mit = mapped.begin_left(); mit != mapped.end_left(); ++mit, ++it) {
+    EXPECT_EQ(*mit, *it);
+    EXPECT_EQ(*mit.flip(), *it.flip());
+    EXPECT_EQ(*mit.flip().flip(), *it);
+  }
+  for (uint64_t key = 0; key < 100000; key += 37) {
+    EXPECT_EQ(mapped.find_left(key) == mapped.end_left(), b.find_left(key) == b.end_left());
+    EXPECT_EQ(mapped.lower_bound_left(key) == mapped.end_left(), b.lower_bound_left(key) == b.end_left());
+    auto right = static_cast<uint32_t>(key);
+    if (b.find_right(right) != b.end_right()) {
+      EXPECT_EQ(mapped.at_right(right), b.at_right(right));
+    } else {
+      EXPECT_THROW(mapped.at_right(right), std::out_of_range);
+    }
+    if (b.upper_bound_right(right) != b.end_right()) {
+      EXPECT_EQ(*mapped.upper_bound_right(right), *b.upper_bound_right(right));
+    }
+  }
+  EXPECT_EQ(*mapped.begin_right(), *b.begin_right());
+
+  auto loaded = bmp::load<decltype(b)>(path);
+  EXPECT_EQ(loaded, b);
+
+  EXPECT_THROW((bmp::mapped_bimap<uint32_t, uint32_t>(path)), std::runtime_error);
+  EXPECT_THROW((bmp::mapped_bimap<uint64_t, uint32_t>(path + ".missing")), std::system_error);
+
+  // 2^62 pairs of 8 + 4 byte values wrap all offsets around to an empty file
+  auto wrapped = bmp::snapshot_header::make(uint64_t(1) << 62, sizeof(uint64_t), sizeof(uint32_t));
+  ASSERT_LT(wrapped.file_size, 1024);
+  {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    std::vector<char> bytes(wrapped.file_size);
+    std::memcpy(bytes.data(), &wrapped, sizeof(wrapped));
+    out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+  }
+  EXPECT_THROW((bmp::mapped_bimap<uint64_t, uint32_t>(path)), std::runtime_error);
+
+  // the comparators are null pointers unless load passes the given ones on
+  using by_pointer = bmp::ordered<bool (*)(const int &, const int &), bmp::red_black>;
+  by_pointer less(&less_by_pointer);
+  bmp::bimap<int, int, by_pointer, by_pointer> ordered_by_pointer(less, less);
+  for (int i = 0; i < 100; i++) {
+    ordered_by_pointer.insert(i, 1000 - i);
+  }
+  bmp::save(ordered_by_pointer, path);
+  auto loaded_by_pointer = bmp::load<decltype(ordered_by_pointer)>(path, less, less);
+  EXPECT_EQ(loaded_by_pointer, ordered_by_pointer);
+  EXPECT_EQ(loaded_by_pointer.at_right(990), 10);
+
+  bmp::save(bmp::bimap<int, int>(), path);
+  EXPECT_TRUE((bmp::mapped_bimap<int, int>(path).empty()));
+  std::remove(path.c_str());
+}
+
+template <typename Map> void check_frozen(int n) {
+  Map b;
+  std::mt19937 e(seed);
+  for (int i = 0; i < n; i++) {
+    b.insert(static_cast<int>(e() % (4 * n)), std::to_string(e() % (4 * n)));
+  }
+
+  auto frozen = b.freeze();
+  EXPECT_EQ(frozen.size(), b.size());
+  auto it = b.begin_right();
+  for (auto fit = frozen.begin_right(); fit != frozen.end_right(); ++fit, ++it) {
+    EXPECT_EQ(*fit, *it);
+    EXPECT_EQ(*fit.flip(), *it.flip());
+    EXPECT_EQ(fit.flip().flip(), fit);
+  }
+  auto lit = b.end_left();
+  for (auto fit = frozen.end_left(); fit != frozen.begin_left();) {
+    --fit;
+    --lit;
+    EXPECT_EQ(*fit, *lit);
+    EXPECT_EQ(frozen.index_of(fit), b.index_of(lit));
+  }
+  for (int key = -1; key <= 4 * n; key++) {
+    auto found = b.find_left(key);
+    if (found == b.end_left()) {
+      EXPECT_EQ(frozen.find_left(key), frozen.end_left());
+      EXPECT_THROW(frozen.at_left(key), std::out_of_range);
+    } else {
+      EXPECT_EQ(frozen.at_left(key), *found.flip());
+      EXPECT_EQ(frozen.at_right(*found.flip()), key);
+    }
+    EXPECT_EQ(frozen.index_of(frozen.lower_bound_left(key)), b.index_of(b.lower_bound_left(key)));
+    EXPECT_EQ(frozen.index_of(frozen.upper_bound_left(key)), b.index_of(b.upper_bound_left(key)));
+    auto right = std::to_string(key);
+    EXPECT_EQ(frozen.index_of(frozen.lower_bound_right(right)), b.index_of(b.lower_bound_right(right)));
+    EXPECT_EQ(frozen.index_of(frozen.upper_bound_right(right)), b.index_of(b.upper_bound_right(right)));
+  }
+  if (!b.empty()) {
+    EXPECT_EQ(*frozen.nth_left(b.size() / 2), *b.nth_left(b.size() / 2));
+  }
+}
+
+TEST(frozen_bimap, same_answers_as_bimap) {
+  for (int n : {0, 1, 2, 7, 1000}) {
+    check_frozen<bmp::bimap<int, std::string>>(n);
+    check_frozen<bmp::bimap<int, std::string, std::greater<int>,
+                            bmp::ordered<std::less<std::string>, bmp::red_black>>>(n);
+  }
+}
+
+template <typename Left, typename Right, typename CompareLeft, typename CompareRight>
+void check_simd_bimap(Left (*make_left)(std::mt19937 &), Right (*make_right)(std::mt19937 &)) {
+  using map_t = bmp::simd_bimap<Left, Right, CompareLeft, CompareRight>;
+  map_t b;
+  std::map<Left, Right, CompareLeft> left_view;
+  std::map<Right, Left, CompareRight> right_view;
+
+  std::mt19937 e(seed);
+  for (size_t i = 0; i < 30000; i++) {
+    if (e() % 3 != 0 || b.empty()) {
+      Left l = make_left(e);
+      Right r = make_right(e);
+      bool inserted = b.insert(l, r) != b.end_left();
+      EXPECT_EQ(inserted, left_view.count(l) == 0 && right_view.count(r) == 0);
+      if (inserted) {
+        left_view[l] = r;
+        right_view[r] = l;
+      }
+    } else {
+      auto it = b.lower_bound_left(make_left(e));
+      if (it == b.end_left()) {
+        it = b.begin_left();
+      }
+      right_view.erase(*it.flip());
+      left_view.erase(*it);
+      if (e() % 2 == 0) {
+        b.erase_left(it);
+      } else {
+        b.erase_right(it.flip());
+      }
+    }
+
+    if (i % 3000 == 0) {
+      ASSERT_EQ(b.size(), left_view.size());
+      size_t k = 0;
+      auto lit = b.begin_left();
+      for (auto const &p : left_view) {
+        EXPECT_EQ(*lit, p.first);
+        EXPECT_EQ(*lit.flip(), p.second);
+        EXPECT_EQ(b.index_of(lit), k);
+        EXPECT_EQ(b.nth_left(k++), lit);
+        lit++;
+      }
+      EXPECT_EQ(lit, b.end_left());
+      auto rit = b.end_right();
+      for (auto p = right_view.rbegin(); p != right_view.rend(); p++) {
+        rit--;
+        EXPECT_EQ(*rit, p->first);
+        EXPECT_EQ(*rit.flip(), p->second);
+      }
+      EXPECT_EQ(rit, b.begin_right());
+    }
+    if (i % 100 == 0) {
+      Left l = make_left(e);
+      Right r = make_right(e);
+      auto lower = left_view.lower_bound(l);
+      auto upper = left_view.upper_bound(l);
+      EXPECT_EQ(b.lower_bound_left(l), lower == left_view.end() ? b.end_left() : b.find_left(lower->first));
+      EXPECT_EQ(b.upper_bound_left(l), upper == left_view.end() ? b.end_left() : b.find_left(upper->first));
+      EXPECT_EQ(b.rank_left(l), static_cast<size_t>(std::distance(left_view.begin(), lower)));
+      EXPECT_EQ(b.find_right(r) == b.end_right(), right_view.count(r) == 0);
+      EXPECT_EQ(b.rank_right(r),
+                static_cast<size_t>(std::distance(right_view.begin(), right_view.lower_bound(r))));
+    }
+  }
+
+  map_t copy = b;
+  EXPECT_EQ(copy, b);
+  while (!copy.empty()) {
+    copy.erase_right(copy.nth_right(copy.size() / 2));
+  }
+  EXPECT_EQ(copy.begin_left(), copy.end_left());
+  EXPECT_EQ(b.size(), left_view.size());
+}
+
+TEST(simd_bimap, compare_to_two_maps) {
+  check_simd_bimap<int, int, std::less<int>, std::less<int>>(
+      [](std::mt19937 &e) { return static_cast<int>(e() % 20000) - 10000; },
+      [](std::mt19937 &e) { return static_cast<int>(e()); });
+  check_simd_bimap<uint64_t, int8_t, std::greater<uint64_t>, std::less<int8_t>>(
+      [](std::mt19937 &e) { return static_cast<uint64_t>((uint64_t(e()) << 32 | e()) % 50000 * 0x0000100000000001ull); },
+      [](std::mt19937 &e) { return static_cast<int8_t>(e()); });
+  check_simd_bimap<double, uint16_t, std::less<double>, std::greater<uint16_t>>(
+      [](std::mt19937 &e) { return (static_cast<double>(e() % 20000) - 10000.5) / 7; },
+      [](std::mt19937 &e) { return static_cast<uint16_t>(e()); });
+  check_simd_bimap<float, unsigned, std::greater<float>, std::less<unsigned>>(
+      [](std::mt19937 &e) { return static_cast<float>(e() % 20000) / 3 - 3000; },
+      [](std::mt19937 &e) { return static_cast<unsigned>(e()); });
+}
+
+template <typename Key, typename Count> void check_count_less(Count count) {
+  std::mt19937 e(seed);
+  alignas(64) Key keys[16];
+  for (int round = 0; round < 1000; round++) {
+    for (Key &k : keys) {
+      k = static_cast<Key>((uint64_t(e()) << 32 | e()) >> (round % 8 * 7));
+    }
+    std::sort(std::begin(keys), std::end(keys));
+    for (int i = 0; i < 20; i++) {
+      Key key = i < 16 ? keys[i] : static_cast<Key>(uint64_t(e()) << 32 | e());
+      EXPECT_EQ(count(keys, key), bmp::count_less<Key>(keys, key));
+    }
+  }
+}
+
+TEST(simd_bimap, count_less_variants) {
+  check_count_less<int8_t>([](const int8_t *k, int8_t key) { return bmp::count_less(k, key); });
+  check_count_less<int16_t>([](const int16_t *k, int16_t key) { return bmp::count_less(k, key); });
+  check_count_less<int32_t>([](const int32_t *k, int32_t key) { return bmp::count_less(k, key); });
+  check_count_less<int64_t>([](const int64_t *k, int64_t key) { return bmp::count_less(k, key); });
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+  if (bmp::cpu_has_sse42) {
+    check_count_less<int64_t>([](const int64_t *k, int64_t key) { return bmp::count_less_sse42(k, key); });
+  }
+  if (bmp::cpu_has_avx2) {
+    check_count_less<int32_t>([](const int32_t *k, int32_t key) { return bmp::count_less_avx2(k, key); });
+    check_count_less<int64_t>([](const int64_t *k, int64_t key) { return bmp::count_less_avx2(k, key); });
+  }
+#endif
+}
+
+TEST(simd_bimap, signed_zero_and_extremes) {
+  bmp::simd_bimap<double, int64_t> b;
+  EXPECT_TRUE(b.insert(0.0, std::numeric_limits<int64_t>::max()) != b.end_left());
+  EXPECT_TRUE(b.insert(-0.0, 1) == b.end_left());
+  EXPECT_EQ(b.at_left(-0.0), std::numeric_limits<int64_t>::max());
+  b.insert(-std::numeric_limits<double>::infinity(), std::numeric_limits<int64_t>::min());
+  b.insert(std::numeric_limits<double>::infinity(), 0);
+  b.insert(std::numeric_limits<double>::lowest(), -1);
+  EXPECT_EQ(*b.begin_left(), -std::numeric_limits<double>::infinity());
+  EXPECT_EQ(*b.nth_left(1), std::numeric_limits<double>::lowest());
+  EXPECT_EQ(*b.begin_right(), std::numeric_limits<int64_t>::min());
+  EXPECT_EQ(b.at_right(std::numeric_limits<int64_t>::max()), 0.0);
+  EXPECT_EQ(b.find_right(std::numeric_limits<int64_t>::max()).flip(), b.find_left(0.0));
+  EXPECT_EQ(b.upper_bound_left(1e300), b.nth_left(3));
+}
@@ -0,0 +1,355 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bimap.h"
+#include "flat_iterator.h"
+
+namespace bmp {
+    // Snapshot file of a bimap with trivially copyable values, in native byte order:
+    // a header, then four sections aligned to 64 bytes: the left values in left
+    // order, the right values in right order, and for each of them the position of
+    // its partner in the other section as uint64_t.
+    struct snapshot_header {
+        static constexpr char expected_magic[8] = {'B', 'M', 'P', 'S', 'N', 'A', 'P', '1'};
+        static constexpr std::uint32_t byte_order_mark = 0x01020304;
+        static constexpr std::uint64_t alignment = 64;
+
+        char magic[8];
+        std::uint32_t byte_order;
+        std::uint32_t index_size;
+        std::uint64_t count;
+        std::uint64_t left_size;
+        std::uint64_t right_size;
+        std::uint64_t lefts_offset;
+        std::uint64_t rights_offset;
+        std::uint64_t right_of_left_offset;
+        std::uint64_t left_of_right_offset;
+        std::uint64_t file_size;
+
+        static std::uint64_t align(std::uint64_t offset) {
+            return (offset + alignment - 1) / alignment * alignment;
+        }
+
+        static snapshot_header make(std::uint64_t count, std::uint64_t left_size, std::uint64_t right_size) {
+            snapshot_header header{};
+            std::memcpy(header.magic, expected_magic, sizeof(header.magic));
+            header.byte_order = byte_order_mark;
+            header.index_size = sizeof(std::uint64_t);
+            header.count = count;
+            header.left_size = left_size;
+            header.right_size = right_size;
+            header.lefts_offset = align(sizeof(snapshot_header));
+            header.rights_offset = align(header.lefts_offset + count * left_size);
+            header.right_of_left_offset = align(header.rights_offset + count * right_size);
+            header.left_of_right_offset = align(header.right_of_left_offset + count * sizeof(std::uint64_t));
+            header.file_size = header.left_of_right_offset + count * sizeof(std::uint64_t);
+            return header;
+        }
+
+        // Whether this is a header written by make() for these value sizes and a
+        // file of file_size_ bytes. A count that does not fit into the file is
+        // rejected before make() computes offsets that could wrap around.
+        bool is_valid_for(std::uint64_t left_size_, std::uint64_t right_size_, std::uint64_t file_size_) const {
+            if (std::memcmp(magic, expected_magic, sizeof(magic)) != 0 || byte_order != byte_order_mark ||
+                index_size != sizeof(std::uint64_t) || left_size != left_size_ || right_size != right_size_ ||
+                file_size != file_size_) {
+                return false;
+            }
+            if (count > file_size / (left_size + right_size + 2 * sizeof(std::uint64_t))) {
+                return false;
+            }
+            snapshot_header expected = make(count, left_size, right_size);
+            return lefts_offset == expected.lefts_offset && rights_offset == expected.rights_offset &&
+                   right_of_left_offset == expected.right_of_left_offset &&
+                   left_of_right_offset == expected.left_of_right_offset && file_size == expected.file_size;
+        }
+    };
+
+    // Writes the pairs of a bimap with two ordered sides to out as a snapshot file.
+    template<typename Left, typename Right, typename CompareLeft, typename CompareRight, typename Allocator>
+    void save(const bimap<Left, Right, CompareLeft, CompareRight, Allocator>& map, std::ostream& out) {
+        using map_t = bimap<Left, Right, CompareLeft, CompareRight, Allocator>;
+        static_assert(std::is_trivially_copyable_v<Left> && std::is_trivially_copyable_v<Right>,
+                      "snapshots store values byte for byte");
+        static_assert(map_t::left_tree_t::is_ordered && map_t::right_tree_t::is_ordered,
+                      "snapshots store both sides in order");
+
+        snapshot_header header = snapshot_header::make(map.size(), sizeof(Left), sizeof(Right));
+        std::uint64_t written = 0;
+        auto write = [&out, &written](const void* data, std::uint64_t bytes) {
+            out.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+            written += bytes;
+        };
+        auto pad_to = [&write, &written](std::uint64_t offset) {
+            static constexpr char zeros[snapshot_header::alignment] = {};
+            write(zeros, offset - written);
+        };
+
+        write(&header, sizeof(header));
+        pad_to(header.lefts_offset);
+        for (auto it = map.begin_left(); it != map.end_left(); ++it) {
+            write(&*it, sizeof(Left));
+        }
+        pad_to(header.rights_offset);
+        for (auto it = map.begin_right(); it != map.end_right(); ++it) {
+            write(&*it, sizeof(Right));
+        }
+
+        std::vector<std::uint64_t> right_of_left;
+        std::vector<std::uint64_t> left_of_right;
+        partner_positions(map, right_of_left, left_of_right);
+        pad_to(header.right_of_left_offset);
+        write(right_of_left.data(), right_of_left.size() * sizeof(std::uint64_t));
+        pad_to(header.left_of_right_offset);
+        write(left_of_right.data(), left_of_right.size() * sizeof(std::uint64_t));
+        if (!out) {
+            throw std::runtime_error("Bimap snapshot could not be written");
+        }
+    }
+
+    template<typename Left, typename Right, typename CompareLeft, typename CompareRight, typename Allocator>
+    void save(const bimap<Left, Right, CompareLeft, CompareRight, Allocator>& map, const std::string& path) {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            throw std::runtime_error("Bimap snapshot could not be created: " + path);
+        }
+        save(map, out);
+        out.close();
+        if (!out) {
+            throw std::runtime_error("Bimap snapshot could not be written: " + path);
+        }
+    }
+
+    // Read-only bimap served straight from a memory-mapped snapshot file: lookups
+    // are binary searches in the sorted sections and flip() follows the partner
+    // positions, so opening it costs O(1) whatever the size. Comparators must order
+    // values like the ones of the bimap that was saved. Only the header is checked:
+    // the sections are trusted to be sorted and the partner positions to be below
+    // size(), as save() writes them, or lookups and flip() read outside the mapping.
+    template<typename Left,
+            typename Right,
+            typename CompareLeft = std::less<Left>,
+            typename CompareRight = std::less<Right>>
+    class mapped_bimap {
+    public:
+        using left_t = Left;
+        using right_t = Right;
+
+        static_assert(std::is_trivially_copyable_v<Left> && std::is_trivially_copyable_v<Right>,
+                      "snapshots store values byte for byte");
+
+        using left_iterator = flat_iterator<mapped_bimap, true>;
+        using right_iterator = flat_iterator<mapped_bimap, false>;
+
+        // Maps the snapshot file at path; throws std::system_error if it can not be
+        // mapped and std::runtime_error if it is not a snapshot of these types.
+        explicit mapped_bimap(const std::string& path,
+                              CompareLeft compare_left = CompareLeft(),
+                              CompareRight compare_right = CompareRight())
+                : left_cmp(std::move(compare_left))
+                , right_cmp(std::move(compare_right)) {
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                throw std::system_error(errno, std::generic_category(), "Bimap snapshot could not be opened: " + path);
+            }
+            struct stat info {};
+            if (::fstat(fd, &info) != 0) {
+                int error = errno;
+                ::close(fd);
+                throw std::system_error(error, std::generic_category(), "Bimap snapshot could not be opened: " + path);
+            }
+            mapped_size = static_cast<std::size_t>(info.st_size);
+            if (mapped_size < sizeof(snapshot_header)) {
+                ::close(fd);
+                throw std::runtime_error("Bimap snapshot is truncated: " + path);
+            }
+            void* address = ::mmap(nullptr, mapped_size, PROT_READ, MAP_SHARED, fd, 0);
+            int error = errno;
+            ::close(fd);
+            if (address == MAP_FAILED) {
+                throw std::system_error(error, std::generic_category(), "Bimap snapshot could not be mapped: " + path);
+            }
+            mapped = static_cast<const char*>(address);
+
+            snapshot_header header;
+            std::memcpy(&header, mapped, sizeof(header));
+            if (!header.is_valid_for(sizeof(Left), sizeof(Right), mapped_size)) {
+                ::munmap(address, mapped_size);
+                throw std::runtime_error("Bimap snapshot does not match the bimap types: " + path);
+            }
+            count = static_cast<std::size_t>(header.count);
+            lefts = reinterpret_cast<const left_t*>(mapped + header.lefts_offset);
+            rights = reinterpret_cast<const right_t*>(mapped + header.rights_offset);
+            right_of_left = reinterpret_cast<const std::uint64_t*>(mapped + header.right_of_left_offset);
+            left_of_right = reinterpret_cast<const std::uint64_t*>(mapped + header.left_of_right_offset);
+        }
+
+        mapped_bimap(const mapped_bimap&) = delete;
+        mapped_bimap& operator=(const mapped_bimap&) = delete;
+
+        ~mapped_bimap() {
+            ::munmap(const_cast<char*>(mapped), mapped_size);
+        }
+
+        left_iterator find_left(const left_t& left) const {
+            left_iterator it = lower_bound_left(left);
+            return (it == end_left() || left_cmp(left, *it)) ? end_left() : it;
+        }
+
+        right_iterator find_right(const right_t& right) const {
+            right_iterator it = lower_bound_right(right);
+            return (it == end_right() || right_cmp(right, *it)) ? end_right() : it;
+        }
+
+        const right_t& at_left(const left_t& key) const {
+            left_iterator it = find_left(key);
+            if (it == end_left()) {
+                throw std::out_of_range("Bimap does not contains left key");
+            }
+            return *it.flip();
+        }
+
+        const left_t& at_right(const right_t& key) const {
+            right_iterator it = find_right(key);
+            if (it == end_right()) {
+                throw std::out_of_range("Bimap does not contains right key");
+            }
+            return *it.flip();
+        }
+
+        left_iterator lower_bound_left(const left_t& left) const {
+            return left_iterator(this, std::lower_bound(lefts, lefts + count, left, left_cmp) - lefts);
+        }
+
+        left_iterator upper_bound_left(const left_t& left) const {
+            return left_iterator(this, std::upper_bound(lefts, lefts + count, left, left_cmp) - lefts);
+        }
+
+        right_iterator lower_bound_right(const right_t& right) const {
+            return right_iterator(this, std::lower_bound(rights, rights + count, right, right_cmp) - rights);
+        }
+
+        right_iterator upper_bound_right(const right_t& right) const {
+            return right_iterator(this, std::upper_bound(rights, rights + count, right, right_cmp) - rights);
+        }
+
+        left_iterator nth_left(std::size_t k) const {
+            return left_iterator(this, std::min(k, count));
+        }
+
+        right_iterator nth_right(std::size_t k) const {
+            return right_iterator(this, std::min(k, count));
+        }
+
+        left_iterator begin_left() const {
+            return left_iterator(this, 0);
+        }
+
+        left_iterator end_left() const {
+            return left_iterator(this, count);
+        }
+
+        right_iterator begin_right() const {
+            return right_iterator(this, 0);
+        }
+
+        right_iterator end_right() const {
+            return right_iterator(this, count);
+        }
+
+        [[nodiscard]] std::size_t size() const {
+            return count;
+        }
+
+        [[nodiscard]] bool empty() const {
+            return count == 0;
+        }
+
+    private:
+        friend left_iterator;
+        friend right_iterator;
+
+        template<bool IsLeft>
+        const auto& value(std::size_t i) const {
+            if constexpr (IsLeft) {
+                return lefts[i];
+            } else {
+                return rights[i];
+            }
+        }
+
+        template<bool IsLeft>
+        std::uint64_t partner(std::size_t i) const {
+            return IsLeft ? right_of_left[i] : left_of_right[i];
+        }
+
+        template<bool>
+        static std::size_t next(std::size_t i) {
+            return i + 1;
+        }
+
+        template<bool>
+        static std::size_t prev(std::size_t i) {
+            return i - 1;
+        }
+
+        CompareLeft left_cmp;
+        CompareRight right_cmp;
+
+        const char* mapped = nullptr;
+        std::size_t mapped_size = 0;
+        std::size_t count = 0;
+        const left_t* lefts = nullptr;
+        const right_t* rights = nullptr;
+        const std::uint64_t* right_of_left = nullptr;
+        const std::uint64_t* left_of_right = nullptr;
+    };
+
+    // Reads a snapshot file into a mutable bimap: the left section is already in
+    // order, so the bimap is bulk built by the sorted_left constructor. The other
+    // arguments go to that constructor after the pairs: the comparators and an
+    // allocator, as for the bimap constructors. The comparators must order the
+    // values like those of the saved bimap, or std::invalid_argument is thrown.
+    template<typename Bimap, typename... Args>
+    Bimap load(const std::string& path, Args&&... args) {
+        mapped_bimap<typename Bimap::left_t, typename Bimap::right_t> file(path);
+
+        struct pair_iterator {
+            std::pair<typename Bimap::left_t, typename Bimap::right_t> operator*() const {
+                return {*it, *it.flip()};
+            }
+
+            pair_iterator& operator++() {
+                ++it;
+                return *this;
+            }
+
+            bool operator!=(const pair_iterator& other) const {
+                return it != other.it;
+            }
+
+            typename decltype(file)::left_iterator it;
+        };
+        return Bimap(sorted_left, pair_iterator{file.begin_left()}, pair_iterator{file.end_left()},
+                     std::forward<Args>(args)...);
+    }
+}
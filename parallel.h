@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace bmp {
+    // Number of threads to use for a thread_count argument, where 0 means one per
+    // hardware thread.
+    inline std::size_t resolve_thread_count(std::size_t thread_count) {
+        if (thread_count == 0) {
+            thread_count = std::thread::hardware_concurrency();
+        }
+        return std::max<std::size_t>(thread_count, 1);
+    }
+
+    // Calls task(i) for every i in [0, count), task 0 on the calling thread and the
+    // others on threads of their own (or on the calling thread if one can not be
+    // started). Returns when all tasks are done, rethrowing the first exception.
+    template<class Task>
+    void run_parallel(std::size_t count, Task task) {
+        std::vector<std::exception_ptr> errors(count);
+        auto run = [&task, &errors](std::size_t i) {
+            try {
+                task(i);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(count);
+        for (std::size_t i = 1; i < count; i++) {
+            try {
+                threads.emplace_back(run, i);
+            } catch (const std::system_error&) {
+                run(i);
+            }
+        }
+        run(0);
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        for (const std::exception_ptr& error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+    }
+
+    // Smallest number of elements worth a thread of their own.
+    inline constexpr std::size_t parallel_grain = 4096;
+
+    inline std::size_t chunk_count(std::size_t n, std::size_t thread_count) {
+        return std::max<std::size_t>(std::min(thread_count, n / parallel_grain), 1);
+    }
+
+    // Splits [0, n) into at most thread_count contiguous chunks and calls
+    // f(begin, end) for each of them in parallel.
+    template<class F>
+    void parallel_chunks(std::size_t n, std::size_t thread_count, F f) {
+        std::size_t chunks = chunk_count(n, thread_count);
+        run_parallel(chunks, [n, chunks, &f](std::size_t i) {
+            f(n * i / chunks, n * (i + 1) / chunks);
+        });
+    }
+
+    // Stable sort of thread_count chunks in parallel, followed by rounds of merges
+    // of neighbouring runs, also in parallel.
+    template<class RandomIt, class Compare>
+    void parallel_stable_sort(RandomIt first, RandomIt last, Compare cmp, std::size_t thread_count) {
+        auto n = static_cast<std::size_t>(last - first);
+        std::size_t chunks = chunk_count(n, thread_count);
+        if (chunks == 1) {
+            std::stable_sort(first, last, cmp);
+            return;
+        }
+
+        std::vector<std::size_t> bounds(chunks + 1);
+        for (std::size_t i = 0; i <= chunks; i++) {
+            bounds[i] = n * i / chunks;
+        }
+        run_parallel(chunks, [&](std::size_t i) {
+            std::stable_sort(first + bounds[i], first + bounds[i + 1], cmp);
+        });
+
+        while (bounds.size() > 2) {
+            std::size_t runs = bounds.size() - 1;
+            run_parallel(runs / 2, [&](std::size_t i) {
+                std::inplace_merge(first + bounds[2 * i], first + bounds[2 * i + 1], first + bounds[2 * i + 2], cmp);
+            });
+
+            std::vector<std::size_t> merged;
+            for (std::size_t i = 0; i < bounds.size(); i += 2) {
+                merged.push_back(bounds[i]);
+            }
+            if (merged.back() != n) {
+                merged.push_back(n);
+            }
+            bounds = std::move(merged);
+        }
+    }
+}
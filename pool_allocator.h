@@ -0,0 +1,160 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace bmp {
+    // Slab allocator for fixed-size objects. Memory is requested from the heap in
+    // slabs of `slots_per_slab` slots and handed out sequentially; freed slots go to
+    // an intrusive free list and are reused before the slab is advanced. Every slot
+    // size gets its own bucket, so one pool can serve all rebinds of an allocator.
+    // The pool is not thread-safe.
+    class node_pool {
+    public:
+        explicit node_pool(std::size_t slots_per_slab = 1024)
+                : slots_per_slab(std::max<std::size_t>(slots_per_slab, 1)) {
+        }
+
+        node_pool(const node_pool&) = delete;
+        node_pool& operator=(const node_pool&) = delete;
+
+        ~node_pool() {
+            for (bucket& b : buckets) {
+                for (void* slab : b.slabs) {
+                    ::operator delete(slab, std::align_val_t(b.alignment));
+                }
+            }
+        }
+
+        void* allocate(std::size_t bytes, std::size_t alignment) {
+            bucket& b = get_bucket(bytes, alignment);
+
+            if (b.free_list != nullptr) {
+                free_slot* slot = b.free_list;
+                b.free_list = slot->next;
+                return slot;
+            }
+
+            if (b.cursor == b.end) {
+                std::size_t slab_bytes = b.slot_size * slots_per_slab;
+                b.slabs.reserve(b.slabs.size() + 1);
+                b.cursor = static_cast<char*>(::operator new(slab_bytes, std::align_val_t(b.alignment)));
+                b.end = b.cursor + slab_bytes;
+                b.slabs.push_back(b.cursor);
+            }
+
+            void* result = b.cursor;
+            b.cursor += b.slot_size;
+            return result;
+        }
+
+        void deallocate(void* ptr, std::size_t bytes, std::size_t alignment) {
+            bucket& b = get_bucket(bytes, alignment);
+            b.free_list = ::new(ptr) free_slot{b.free_list};
+        }
+
+        [[nodiscard]] std::size_t get_slots_per_slab() const {
+            return slots_per_slab;
+        }
+
+    private:
+        struct free_slot {
+            free_slot* next;
+        };
+
+        struct bucket {
+            std::size_t slot_size;
+            std::size_t alignment;
+            free_slot* free_list = nullptr;
+            char* cursor = nullptr;
+            char* end = nullptr;
+            std::vector<void*> slabs = {};
+        };
+
+        bucket& get_bucket(std::size_t bytes, std::size_t alignment) {
+            alignment = std::max(alignment, alignof(free_slot));
+            std::size_t slot_size = std::max(bytes, sizeof(free_slot));
+            slot_size = (slot_size + alignment - 1) / alignment * alignment;
+
+            for (bucket& b : buckets) {
+                if (b.slot_size == slot_size && b.alignment == alignment) {
+                    return b;
+                }
+            }
+
+            buckets.push_back(bucket{slot_size, alignment});
+            return buckets.back();
+        }
+
+        std::size_t slots_per_slab;
+        std::vector<bucket> buckets;
+    };
+
+    // std::allocator-compatible front end of node_pool. Single-object requests are
+    // served by the shared pool, array requests go straight to the heap. Copies and
+    // rebinds share the pool; a copied container gets a fresh pool of its own and a
+    // copy-assigned one keeps its own, so a copy can be handed to another thread.
+    template<class T>
+    class pool_allocator {
+    public:
+        using value_type = T;
+
+        using propagate_on_container_copy_assignment = std::false_type;
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap = std::true_type;
+        using is_always_equal = std::false_type;
+
+        explicit pool_allocator(std::size_t slots_per_slab = 1024)
+                : pool(std::make_shared<node_pool>(slots_per_slab)) {
+        }
+
+        explicit pool_allocator(std::shared_ptr<node_pool> pool)
+                : pool(std::move(pool)) {
+        }
+
+        template<class U>
+        pool_allocator(const pool_allocator<U>& other) noexcept
+                : pool(other.get_pool()) {
+        }
+
+        T* allocate(std::size_t n) {
+            if (n == 1) {
+                return static_cast<T*>(pool->allocate(sizeof(T), alignof(T)));
+            }
+            return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+        }
+
+        void deallocate(T* ptr, std::size_t n) noexcept {
+            if (n == 1) {
+                pool->deallocate(ptr, sizeof(T), alignof(T));
+            } else {
+                ::operator delete(ptr, std::align_val_t(alignof(T)));
+            }
+        }
+
+        pool_allocator select_on_container_copy_construction() const {
+            return pool_allocator(pool->get_slots_per_slab());
+        }
+
+        [[nodiscard]] const std::shared_ptr<node_pool>& get_pool() const noexcept {
+            return pool;
+        }
+
+        template<class U>
+        friend bool operator==(const pool_allocator& a, const pool_allocator<U>& b) noexcept {
+            return a.get_pool() == b.get_pool();
+        }
+
+        template<class U>
+        friend bool operator!=(const pool_allocator& a, const pool_allocator<U>& b) noexcept {
+            return !(a == b);
+        }
+
+    private:
+        std::shared_ptr<node_pool> pool;
+    };
+}
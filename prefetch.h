@@ -0,0 +1,13 @@
+#pragma once
+
+namespace bmp {
+    // Hint that the cache line at ptr will be read soon; a no-op where the
+    // compiler has no prefetch builtin.
+    inline void prefetch(const void* ptr) {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(ptr);
+#else
+        (void) ptr;
+#endif
+    }
+}
@@ -0,0 +1,336 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "bimap.h"
+
+namespace bmp {
+    // Bimap for many readers and few writers that may read slightly stale data.
+    // Readers take the current version with snapshot() and use the usual bimap
+    // lookup API on it without taking any lock; a snapshot never changes.
+    //
+    // Versions are published through an atomic pointer and protected by hazard
+    // pointers: snapshot() announces the version it read in a slot of its own and
+    // checks that it is still current, and a version that no slot announces can
+    // not be reached by readers anymore. Slots are reused by later snapshots and a
+    // new one is only allocated when all are held, so snapshot() is lock-free once
+    // there are as many slots as snapshots are held at the same time. Snapshots
+    // must not outlive the snapshot_bimap.
+    //
+    // Writers queue insertions and erasures, which become visible to readers on
+    // publish(). A version stays shared with readers, so publish() does not modify
+    // it in place: it replays the writes of the last two batches on the version
+    // before the current one if no reader holds it anymore, and copies the current
+    // version otherwise. Replaced versions that readers still hold are freed by a
+    // later publish() or update(). Lookups must not restructure the trees, so
+    // splay_on_access sides are rejected.
+    template<typename Left,
+            typename Right,
+            typename CompareLeft = std::less<Left>,
+            typename CompareRight = std::less<Right>,
+            typename Allocator = std::allocator<std::pair<Left, Right>>>
+    class snapshot_bimap {
+        struct hazard_slot;
+
+    public:
+        using left_t = Left;
+        using right_t = Right;
+        using bimap_t = bimap<Left, Right, CompareLeft, CompareRight, Allocator>;
+
+        static_assert(!bimap_t::left_tree_t::restructures_on_access &&
+                      !bimap_t::right_tree_t::restructures_on_access,
+                      "snapshots are read concurrently, lookups must not modify them");
+
+        // Keeps one version readable until it is destroyed or reassigned.
+        class snapshot_t {
+        public:
+            snapshot_t() = default;
+
+            snapshot_t(snapshot_t&& other) noexcept
+                    : slot(std::exchange(other.slot, nullptr))
+                    , map(std::exchange(other.map, nullptr)) {
+            }
+
+            snapshot_t& operator=(snapshot_t&& other) noexcept {
+                if (this != &other) {
+                    release();
+                    slot = std::exchange(other.slot, nullptr);
+                    map = std::exchange(other.map, nullptr);
+                }
+                return *this;
+            }
+
+            ~snapshot_t() {
+                release();
+            }
+
+            const bimap_t& operator*() const {
+                return *map;
+            }
+
+            const bimap_t* operator->() const {
+                return map;
+            }
+
+            [[nodiscard]] const bimap_t* get() const {
+                return map;
+            }
+
+            explicit operator bool() const {
+                return map != nullptr;
+            }
+
+        private:
+            friend class snapshot_bimap;
+
+            snapshot_t(hazard_slot* slot, const bimap_t* map)
+                    : slot(slot)
+                    , map(map) {
+            }
+
+            void release() {
+                if (slot != nullptr) {
+                    // pairs with the acquire of the writer that scans the slot
+                    slot->pointer.store(nullptr, std::memory_order_release);
+                    slot->in_use.store(false, std::memory_order_release);
+                    slot = nullptr;
+                    map = nullptr;
+                }
+            }
+
+            hazard_slot* slot = nullptr;
+            const bimap_t* map = nullptr;
+        };
+
+        snapshot_bimap()
+                : snapshot_bimap(bimap_t()) {
+        }
+
+        explicit snapshot_bimap(bimap_t initial)
+                : current(new bimap_t(std::move(initial))) {
+        }
+
+        snapshot_bimap(const snapshot_bimap&) = delete;
+        snapshot_bimap& operator=(const snapshot_bimap&) = delete;
+
+        ~snapshot_bimap() {
+            delete current.load(std::memory_order_relaxed);
+            hazard_slot* slot = slots.load(std::memory_order_relaxed);
+            while (slot != nullptr) {
+                assert(!slot->in_use.load(std::memory_order_relaxed));
+                delete std::exchange(slot, slot->next);
+            }
+        }
+
+        // The last published version. The version is announced before it is checked
+        // against current again, both sequentially consistent, so that a writer that
+        // replaced it in between either sees the announcement or is seen here.
+        snapshot_t snapshot() const {
+            hazard_slot* slot = acquire_slot();
+            const bimap_t* version = current.load(std::memory_order_acquire);
+            while (true) {
+                slot->pointer.store(version, std::memory_order_seq_cst);
+                const bimap_t* again = current.load(std::memory_order_seq_cst);
+                if (again == version) {
+                    return snapshot_t(slot, version);
+                }
+                version = again;
+            }
+        }
+
+        // Number of versions published so far.
+        [[nodiscard]] std::uint64_t version() const {
+            return published.load(std::memory_order_acquire);
+        }
+
+        // Writes take effect on the next publish(), in the order they were queued,
+        // with the same semantics as the bimap methods of the same names.
+        void insert(left_t left, right_t right) {
+            std::lock_guard lock(writer_mutex);
+            pending.emplace_back(insert_op{std::move(left), std::move(right)});
+        }
+
+        void erase_left(left_t left) {
+            std::lock_guard lock(writer_mutex);
+            pending.emplace_back(erase_left_op{std::move(left)});
+        }
+
+        void erase_right(right_t right) {
+            std::lock_guard lock(writer_mutex);
+            pending.emplace_back(erase_right_op{std::move(right)});
+        }
+
+        // Makes the queued writes visible to readers as a new version.
+        void publish() {
+            std::lock_guard lock(writer_mutex);
+            if (pending.empty()) {
+                return;
+            }
+
+            std::unique_ptr<bimap_t> next = take_spare();
+            if (next) {
+                replay(*next, spare_log);
+            } else {
+                next = std::make_unique<bimap_t>(*current.load(std::memory_order_relaxed));
+            }
+            replay(*next, pending);
+            spare_log = std::move(pending);
+            pending.clear();
+            install(std::move(next), true);
+        }
+
+        // Publishes a version that is f applied to a copy of the current one, after
+        // the queued writes.
+        template<class F>
+        void update(F f) {
+            std::lock_guard lock(writer_mutex);
+            auto next = std::make_unique<bimap_t>(*current.load(std::memory_order_relaxed));
+            replay(*next, pending);
+            pending.clear();
+            f(*next);
+            install(std::move(next), false);
+        }
+
+    private:
+        // Announces the version a snapshot reads. Slots form a list that only grows;
+        // in_use hands a slot to one snapshot at a time.
+        struct hazard_slot {
+            std::atomic<const bimap_t*> pointer{nullptr};
+            std::atomic<bool> in_use{true};
+            hazard_slot* next = nullptr;
+        };
+
+        struct insert_op {
+            left_t left;
+            right_t right;
+        };
+
+        struct erase_left_op {
+            left_t left;
+        };
+
+        struct erase_right_op {
+            right_t right;
+        };
+
+        using op_t = std::variant<insert_op, erase_left_op, erase_right_op>;
+
+        struct apply_op {
+            void operator()(const insert_op& op) const {
+                map.try_insert(op.left, op.right);
+            }
+
+            void operator()(const erase_left_op& op) const {
+                map.erase_left(op.left);
+            }
+
+            void operator()(const erase_right_op& op) const {
+                map.erase_right(op.right);
+            }
+
+            bimap_t& map;
+        };
+
+        static void replay(bimap_t& map, const std::vector<op_t>& ops) {
+            for (auto const& op : ops) {
+                std::visit(apply_op{map}, op);
+            }
+        }
+
+        // A free slot, or a new one pushed onto the list if all are in use.
+        hazard_slot* acquire_slot() const {
+            for (hazard_slot* cur = slots.load(std::memory_order_acquire); cur != nullptr; cur = cur->next) {
+                bool expected = false;
+                if (!cur->in_use.load(std::memory_order_relaxed) &&
+                    cur->in_use.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+                    return cur;
+                }
+            }
+
+            auto* slot = new hazard_slot();
+            hazard_slot* head = slots.load(std::memory_order_relaxed);
+            do {
+                slot->next = head;
+            } while (!slots.compare_exchange_weak(head, slot, std::memory_order_release, std::memory_order_relaxed));
+            return slot;
+        }
+
+        // Versions announced by readers, sorted. The loads pair with the release of
+        // the slots, so that a version no reader announces anymore is no longer read.
+        std::vector<const bimap_t*> hazards() const {
+            std::vector<const bimap_t*> result;
+            for (hazard_slot* cur = slots.load(std::memory_order_acquire); cur != nullptr; cur = cur->next) {
+                const bimap_t* pointer = cur->pointer.load(std::memory_order_seq_cst);
+                if (pointer != nullptr) {
+                    result.push_back(pointer);
+                }
+            }
+            std::sort(result.begin(), result.end(), std::less<>());
+            return result;
+        }
+
+        static bool is_held(const std::vector<const bimap_t*>& held, const bimap_t* version) {
+            return std::binary_search(held.begin(), held.end(), version, std::less<>());
+        }
+
+        // The previous version if no reader can reach it anymore; it is retired
+        // otherwise. It is not published, so no reader can announce it once it is
+        // seen unannounced.
+        std::unique_ptr<bimap_t> take_spare() {
+            if (spare && !is_held(hazards(), spare.get())) {
+                return std::move(spare);
+            }
+            if (spare) {
+                retired.push_back(std::move(spare));
+            }
+            return nullptr;
+        }
+
+        // Publishes next; the replaced version becomes the spare if the writes that
+        // turned it into next are in spare_log, and is retired otherwise. Retired
+        // versions that no reader announces are freed.
+        void install(std::unique_ptr<bimap_t> next, bool logged) {
+            retired.reserve(retired.size() + 2);
+            std::unique_ptr<bimap_t> previous(current.exchange(next.release(), std::memory_order_seq_cst));
+            if (logged) {
+                spare = std::move(previous);
+            } else {
+                if (spare) {
+                    retired.push_back(std::move(spare));
+                }
+                retired.push_back(std::move(previous));
+                spare_log.clear();
+            }
+            published.fetch_add(1, std::memory_order_release);
+
+            std::vector<const bimap_t*> held = hazards();
+            retired.erase(std::remove_if(retired.begin(), retired.end(), [&held](const auto& version) {
+                return !is_held(held, version.get());
+            }), retired.end());
+        }
+
+        // replaced only by writers under writer_mutex, which also read it relaxed
+        std::atomic<bimap_t*> current;
+        std::atomic<std::uint64_t> published{0};
+        mutable std::atomic<hazard_slot*> slots{nullptr};
+
+        std::mutex writer_mutex;
+        std::vector<op_t> pending;
+        // the version published before current and the writes that turned it into
+        // current
+        std::unique_ptr<bimap_t> spare;
+        std::vector<op_t> spare_log;
+        // replaced versions that readers may still hold
+        std::vector<std::unique_ptr<bimap_t>> retired;
+    };
+}
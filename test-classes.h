@@ -49,4 +49,54 @@ struct non_default_constructible {
   }
 private:
   int a;
-};
\ No newline at end of file
+};
+// Node allocator that takes memory from malloc and only marks it as freed, so
+// that freeing a node twice is counted instead of corrupting the heap. The
+// memory is returned by release_all().
+struct tracked_blocks {
+  std::vector<std::pair<void *, bool>> blocks;
+  size_t live = 0;
+  size_t double_frees = 0;
+
+  void release_all() {
+    for (auto &block : blocks) {
+      std::free(block.first);
+    }
+    blocks.clear();
+    live = 0;
+    double_frees = 0;
+  }
+};
+
+inline tracked_blocks tracked;
+
+template <class T> struct tracking_allocator {
+  using value_type = T;
+
+  tracking_allocator() = default;
+  template <class U> tracking_allocator(const tracking_allocator<U> &) {}
+
+  T *allocate(size_t n) {
+    void *block = std::malloc(n * sizeof(T));
+    if (block == nullptr) {
+      throw std::bad_alloc();
+    }
+    tracked.blocks.emplace_back(block, true);
+    tracked.live++;
+    return static_cast<T *>(block);
+  }
+
+  void deallocate(T *ptr, size_t) {
+    for (auto &block : tracked.blocks) {
+      if (block.first == ptr && block.second) {
+        block.second = false;
+        tracked.live--;
+        return;
+      }
+    }
+    tracked.double_frees++;
+  }
+
+  template <class U> friend bool operator==(const tracking_allocator &, const tracking_allocator<U> &) { return true; }
+  template <class U> friend bool operator!=(const tracking_allocator &, const tracking_allocator<U> &) { return false; }
+};